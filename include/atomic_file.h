@@ -0,0 +1,67 @@
+#pragma once
+
+#include <string>
+#include <streambuf>
+#include <vector>
+
+/**
+* \brief A temporary file that lives next to `path` and atomically replaces it.
+*
+* The new contents are written to `get_fd()`, then `commit()` syncs the data
+* and renames the temporary file over `path` so readers observe either the
+* old or the new contents, never a partially written file. The directory is
+* synced after the rename, so once `commit()` returns true the new contents
+* survive a crash.
+*
+* On Linux the temporary file is created with `O_TMPFILE` and only given a
+* name (via `linkat`) right before the rename, so a crash never leaves stray
+* files behind. Mode and ownership of `path` are copied to the new file.
+*
+* \note The destructor discards the temporary file if `commit()` was not called.
+*/
+class AtomicFile {
+    std::string path;
+    std::string tmp_path;
+    int fd = -1;
+    bool anonymous = false;
+
+    bool link_anonymous();
+    bool sync_directory();
+    void close_fd();
+
+    public:
+
+    AtomicFile(const char * path);
+    ~AtomicFile();
+
+    AtomicFile(const AtomicFile & other) = delete;
+    AtomicFile & operator=(const AtomicFile & other) = delete;
+
+    bool is_open() const;
+    int get_fd() const;
+    const std::string & get_path() const;
+
+    bool commit();
+    void discard();
+};
+
+/**
+* \brief A `std::streambuf` that writes to a file descriptor with a large buffer.
+*/
+class FdStreamBuffer : public std::streambuf {
+    int fd;
+    std::vector<char> buffer;
+
+    bool write_all(const char * data, std::size_t size);
+
+    protected:
+
+    int_type overflow(int_type c) override;
+    std::streamsize xsputn(const char * s, std::streamsize n) override;
+    int sync() override;
+
+    public:
+
+    FdStreamBuffer(int fd, std::size_t buffer_size = 1024*1024);
+    ~FdStreamBuffer();
+};
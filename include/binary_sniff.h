@@ -0,0 +1,25 @@
+#pragma once
+
+#include <cstddef>
+
+/**
+* \brief How many leading bytes of a file looks_binary() is given.
+*/
+static const std::size_t BINARY_SNIFF_SIZE = 8*1024;
+
+/**
+* \brief Data with more than one control character in this many bytes is binary.
+*/
+static const std::size_t BINARY_CONTROL_RATIO = 10;
+
+/**
+* \brief True if `data`, the start of a file, does not look like text.
+*
+* Only a NUL byte, or too many control characters other than whitespace,
+* backspace and escape (see `BINARY_CONTROL_RATIO`), make data binary. Text
+* in any ASCII compatible encoding (UTF-8, Latin-1, CP1252) is text, as is
+* UTF-16 that starts with its byte order mark. Runs of bytes that are not
+* control characters are checked a machine word at a time, so plain text
+* costs little more than a `memchr`.
+*/
+bool looks_binary(const char * data, std::size_t length);
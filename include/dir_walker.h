@@ -0,0 +1,92 @@
+#pragma once
+
+#ifdef __linux__
+
+#include <sharded_map.h>
+
+#include <functional>
+#include <memory>
+#include <string>
+
+/**
+* \brief An open directory whose entries are read straight from the kernel.
+*
+* Entries are read with `getdents64` in large batches and handed out one at a
+* time, so a directory with any number of entries is walked in a fixed amount
+* of memory. The type the kernel reports with each entry is trusted, only
+* symbolic links and file systems that do not report a type cost an `fstatat`.
+*
+* Sub directories are opened with `openat` relative to this directory, and a
+* DirWalker is shared by the walkers of its sub directories until they have
+* been opened, so the directory is not looked up again by path.
+*/
+class DirWalker {
+    public:
+
+    enum Type {
+        REGULAR,
+        DIRECTORY,
+        // a dangling symbolic link or an entry that vanished while walking
+        MISSING,
+        // anything else, devices, sockets, fifos
+        OTHER
+    };
+
+    private:
+
+    int fd;
+    std::string path;
+    FileId id;
+
+    DirWalker(int fd, const std::string & path, const FileId & id);
+
+    static std::shared_ptr<DirWalker> from_fd(int fd, const std::string & path);
+
+    public:
+
+    ~DirWalker();
+
+    DirWalker(const DirWalker &) = delete;
+    DirWalker & operator=(const DirWalker &) = delete;
+
+    /**
+    * \brief Opens the directory at `path`, nullptr on failure.
+    */
+    static std::shared_ptr<DirWalker> open(const std::string & path);
+
+    /**
+    * \brief Opens the sub directory `name` of this directory, nullptr on failure.
+    */
+    std::shared_ptr<DirWalker> open_child(const char * name) const;
+
+    const std::string & get_path() const;
+
+    /**
+    * \brief The descriptor of the directory, for opening its entries with `openat`.
+    */
+    int get_fd() const;
+
+    /**
+    * \brief The device and inode of the directory.
+    */
+    const FileId & get_id() const;
+
+    /**
+    * \brief The path of the entry `name`, as `get_path() + "/" + name`.
+    */
+    std::string child_path(const char * name) const;
+
+    /**
+    * \brief Calls `visit` for every entry except `.` and `..`, in the order
+    * the kernel returns them. Symbolic links are reported as what they point to.
+    *
+    * `id` is the entry's device and inode, for a directory the device is this
+    * directory's, which differs from the entry's own if it is a mount point.
+    *
+    * `name` is only valid during the call. Returns false if reading the
+    * directory failed part way.
+    */
+    bool for_each(const std::function<void(const char * name, Type type, const FileId & id)> & visit) const;
+};
+
+#endif
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <output_sink.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/**
+* \brief Writes one JSON object as a single line straight into an OutputBuffer,
+* field by field, without building it in memory first.
+*
+* Field names are written as given and must not need escaping. A string value
+* that is valid UTF-8 is written as a JSON string, escaped where JSON needs it.
+* Any other is written as an object `{"bytes":"..."}` with its bytes in base64,
+* so every line is valid JSON and the exact bytes can be read back from it.
+*
+* A string value may be written in parts with begin_string(), string_part() and
+* end_string(), the parts are gathered so the whole value is checked at once.
+*/
+class JsonRecord {
+    OutputBuffer & out;
+    bool first = true;
+    // the name and the parts of the string value being written in parts
+    const char * part_name = nullptr;
+    std::string parts;
+
+    void name(const char * name);
+    void escape(const char * data, std::size_t length);
+    void base64(const char * data, std::size_t length);
+
+    public:
+
+    /**
+    * \brief Starts the object.
+    */
+    explicit JsonRecord(OutputBuffer & out);
+
+    JsonRecord(const JsonRecord &) = delete;
+    JsonRecord & operator=(const JsonRecord &) = delete;
+
+    JsonRecord & number(const char * name, std::uint64_t value);
+
+    JsonRecord & string(const char * name, const char * data, std::size_t length);
+
+    JsonRecord & begin_string(const char * name);
+
+    JsonRecord & string_part(const char * data, std::size_t length);
+
+    JsonRecord & end_string();
+
+    /**
+    * \brief Ends the object and its line.
+    */
+    void end();
+};
@@ -0,0 +1,11 @@
+#pragma once
+
+#include <cstddef>
+
+/**
+* \brief The number of newlines (`'\n'`) in `data`.
+*
+* Counted a machine word at a time, with the counts of eight words at once kept
+* in the bytes of a word and added up only every 255 words.
+*/
+std::size_t count_newlines(const char * data, std::size_t length);
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+/**
+* \brief Collects files into batches and hands each batch on in the order of a
+* key, the inode number or the physical location of a file, so a disk that
+* has to seek reads them in one sweep instead of in directory order.
+*
+* Any thread may add files. A full batch is sorted and handed to `sink` by the
+* thread whose add() filled it, flush() hands on what is left.
+*/
+class LocalityBatch {
+    public:
+
+    using Sink = std::function<void(const std::string & path)>;
+
+    private:
+
+    std::size_t batch_size;
+    Sink sink;
+    std::mutex mutex;
+    std::vector<std::pair<std::uint64_t, std::string>> pending;
+
+    void hand_on(std::vector<std::pair<std::uint64_t, std::string>> & batch);
+
+    public:
+
+    LocalityBatch(std::size_t batch_size, Sink sink);
+
+    void add(std::string path, std::uint64_t key);
+
+    void flush();
+};
+
+/**
+* \brief The physical byte offset of the first extent of the file at `path`,
+* from the FIEMAP ioctl, or UINT64_MAX if the file has no extents or the
+* file system or platform cannot tell.
+*/
+std::uint64_t first_physical_offset(const char * path);
@@ -0,0 +1,157 @@
+#pragma once
+
+#include <mmap.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+* \brief Writes the matches of a search to a file in fixed width columns, which
+* MatchLogReader uses straight from a mapping of the file, without any parsing.
+*
+* The file holds a header, the blocks of matches, the block table, the path
+* table and a footer of fixed size at its very end:
+*
+*     header       "FRMATCH" and a NUL, u32 version, u32 0x01020304 in the byte order of the file
+*     block        u64 offset[n], u64 length[n], u32 file[n], u32 pattern[n]
+*     ...
+*     block table  u64 position, u64 count, of every block
+*     path table   u64 end[path count], then the paths one after another, padded to 8 bytes
+*     footer       u64 block table position, u64 block count, u64 path table position,
+*                  u64 path count, u64 match count, "FRMATCH" and a NUL
+*
+* Numbers are in the byte order of the machine that wrote the file and every
+* column is aligned to its own size. `file` is an index into the path table,
+* `pattern` the index of the search item that matched, in the order given.
+*
+* Every thread collects its matches in a block of its own, which is written once
+* it is full, so the matches of a file are in order but the matches of files
+* scanned at the same time may be in blocks in any order.
+*/
+class MatchLog {
+    public:
+
+    static const std::uint32_t NO_FILE = 0xFFFFFFFF;
+
+    // the number of matches a block holds at most
+    static const std::size_t BLOCK_CAPACITY = 64*1024;
+
+    struct Block {
+        std::vector<std::uint64_t> offset;
+        std::vector<std::uint64_t> length;
+        std::vector<std::uint32_t> file;
+        std::vector<std::uint32_t> pattern;
+    };
+
+    private:
+
+    int fd = -1;
+    bool failed = false;
+    // tells the logs apart for thread_block(), an address may be reused by a later log
+    std::uint64_t id;
+    std::uint64_t position = 0;
+    std::uint64_t matches = 0;
+
+    std::mutex mutex;
+    std::vector<std::string> paths;
+    std::vector<std::pair<std::uint64_t, std::uint64_t>> block_table;
+    // the block of every thread that added a match
+    std::vector<std::unique_ptr<Block>> blocks;
+
+    bool write(const void * data, std::size_t length);
+    void write_block(Block & block);
+    Block & thread_block();
+
+    public:
+
+    /**
+    * \brief Creates the file at `path`, or replaces it, check is_open().
+    */
+    explicit MatchLog(const char * path);
+
+    /**
+    * \brief Closes the file, call finish() first or the file is left incomplete.
+    */
+    ~MatchLog();
+
+    MatchLog(const MatchLog &) = delete;
+    MatchLog & operator=(const MatchLog &) = delete;
+
+    bool is_open() const;
+
+    /**
+    * \brief Adds `path` to the path table, returns its index.
+    */
+    std::uint32_t add_file(const std::string & path);
+
+    void add(std::uint32_t file, std::uint64_t offset, std::uint64_t length, std::uint32_t pattern);
+
+    /**
+    * \brief Writes the blocks not written yet, the tables and the footer, false
+    * if anything could not be written. No thread may add matches any more.
+    */
+    bool finish();
+};
+
+/**
+* \brief Reads a file written by MatchLog, its columns point into a mapping of the file.
+*/
+class MatchLogReader {
+    public:
+
+    struct Block {
+        std::size_t count;
+        const std::uint64_t * offset;
+        const std::uint64_t * length;
+        const std::uint32_t * file;
+        const std::uint32_t * pattern;
+    };
+
+    private:
+
+    MMapHelper map;
+    std::shared_ptr<MMapHelper::Page> whole;
+    const char * data = nullptr;
+    std::uint64_t size = 0;
+    const std::uint64_t * block_table = nullptr;
+    std::uint64_t blocks = 0;
+    const std::uint64_t * path_ends = nullptr;
+    const char * path_data = nullptr;
+    std::uint64_t paths = 0;
+    std::uint64_t matches = 0;
+    std::string error;
+
+    void fail(const char * message);
+
+    public:
+
+    /**
+    * \brief Maps the file at `path` and checks its header, footer and tables, check is_open().
+    */
+    explicit MatchLogReader(const char * path);
+
+    bool is_open() const;
+
+    /**
+    * \brief Why the file could not be read, if it could not.
+    */
+    const std::string & get_error() const;
+
+    std::uint64_t match_count() const;
+
+    std::size_t block_count() const;
+
+    Block block(std::size_t index) const;
+
+    std::size_t path_count() const;
+
+    /**
+    * \brief The path of a `file` column entry, which must be less than path_count().
+    */
+    std::string_view path(std::uint32_t file) const;
+};
@@ -71,6 +71,12 @@ struct MMapIterator {
     size_t length() const;
     const char * get_api() const;
     size_t get_page_size() const;
+    // the offset in the file the iterator points at
+    size_t get_index() const;
+    // the mapped bytes from the iterator to the end of its page, their number is put in length
+    const char * page_data(size_t & length) const;
+    // moves the iterator n bytes at once
+    MMapIterator & operator+=(difference_type n);
 
     SATISFIES__LEGACY_BIDIRECTIONAL_ITERATOR(MMapIterator);
 
@@ -0,0 +1,279 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+/**
+* \brief A bounded lock-free multi producer multi consumer queue.
+*
+* Every cell carries a sequence number that tells producers and consumers
+* whether it is free or full for their current lap around the ring, so a push
+* or pop is a single compare and swap on the shared position plus a store to
+* the cell (Dmitry Vyukov's bounded MPMC queue).
+*
+* push() and pop() wait while the queue is full or empty, spinning briefly
+* before blocking on a condition variable, which the other side only signals
+* when someone is blocked. After close() pop() drains the queue and then
+* returns false.
+*
+* The queue counts how often it was found full or empty, and its depth at every
+* push, which shows whether the stage before or after it is the slower one.
+*/
+template <typename T>
+class MPMCQueue {
+    public:
+
+    struct Stats {
+        std::size_t capacity;
+        std::uint64_t pushes;
+        std::size_t max_depth;
+        double mean_depth;
+        // pushes that had to wait for a free cell, the consumer was too slow
+        std::uint64_t full_waits;
+        // pops that had to wait for an item, the producer was too slow
+        std::uint64_t empty_waits;
+    };
+
+    private:
+
+    struct Cell {
+        std::atomic<std::size_t> sequence;
+        T data;
+    };
+
+    std::unique_ptr<Cell[]> cells;
+    std::size_t mask;
+
+    alignas(64) std::atomic<std::size_t> enqueue_pos {0};
+    alignas(64) std::atomic<std::size_t> dequeue_pos {0};
+    alignas(64) std::atomic<bool> closed {false};
+
+    std::atomic<std::uint64_t> pushes {0};
+    std::atomic<std::uint64_t> depth_sum {0};
+    std::atomic<std::size_t> max_depth {0};
+    std::atomic<std::uint64_t> full_waits {0};
+    std::atomic<std::uint64_t> empty_waits {0};
+
+    // blocked pushes and pops, a stage may be blocked for as long as a file takes to scan
+    std::mutex wait_mutex;
+    std::condition_variable not_full;
+    std::condition_variable not_empty;
+    std::atomic<unsigned int> blocked_pushes {0};
+    std::atomic<unsigned int> blocked_pops {0};
+    // bumped by notify_idle(), under wait_mutex
+    std::atomic<std::uint64_t> idle_round {0};
+
+    // spins, then yields, false once it is time to block
+    struct Backoff {
+        unsigned int round = 0;
+        bool spin() {
+            if (round < 64) {
+                round++;
+            } else if (round < 128) {
+                round++;
+                std::this_thread::yield();
+            } else {
+                return false;
+            }
+            return true;
+        }
+    };
+
+    // whether the next try_push() or try_pop() may succeed, a position that
+    // moved on since it was read counts as a yes, the caller tries again
+    bool may_push() const {
+        std::size_t pos = enqueue_pos.load(std::memory_order_relaxed);
+        std::size_t sequence = cells[pos & mask].sequence.load(std::memory_order_acquire);
+        return static_cast<std::intptr_t>(sequence) - static_cast<std::intptr_t>(pos) >= 0;
+    }
+
+    bool may_pop() const {
+        std::size_t pos = dequeue_pos.load(std::memory_order_relaxed);
+        std::size_t sequence = cells[pos & mask].sequence.load(std::memory_order_acquire);
+        return static_cast<std::intptr_t>(sequence) - static_cast<std::intptr_t>(pos + 1) >= 0;
+    }
+
+    // the fences pair with the ones in block(), either the waiter sees the
+    // change or the signaller sees the waiter
+    void signal(std::atomic<unsigned int> & blocked, std::condition_variable & cv) {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (blocked.load(std::memory_order_relaxed) != 0) {
+            std::lock_guard<std::mutex> lock(wait_mutex);
+            cv.notify_one();
+        }
+    }
+
+    template <typename Ready>
+    void block(std::atomic<unsigned int> & blocked, std::condition_variable & cv, Ready && ready) {
+        std::unique_lock<std::mutex> lock(wait_mutex);
+        blocked.fetch_add(1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        cv.wait(lock, ready);
+        blocked.fetch_sub(1, std::memory_order_relaxed);
+    }
+
+    void record_push() {
+        std::size_t depth = enqueue_pos.load(std::memory_order_relaxed) - dequeue_pos.load(std::memory_order_relaxed);
+        pushes.fetch_add(1, std::memory_order_relaxed);
+        depth_sum.fetch_add(depth, std::memory_order_relaxed);
+        std::size_t max = max_depth.load(std::memory_order_relaxed);
+        while (depth > max && !max_depth.compare_exchange_weak(max, depth, std::memory_order_relaxed)) {}
+    }
+
+    public:
+
+    /**
+    * \brief `capacity` is rounded up to a power of two, at least 2.
+    */
+    explicit MPMCQueue(std::size_t capacity) {
+        std::size_t size = 2;
+        while (size < capacity) size <<= 1;
+        cells.reset(new Cell[size]);
+        mask = size - 1;
+        for (std::size_t i = 0; i < size; i++) {
+            cells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    MPMCQueue(const MPMCQueue &) = delete;
+    MPMCQueue & operator=(const MPMCQueue &) = delete;
+
+    bool try_push(T & value) {
+        std::size_t pos = enqueue_pos.load(std::memory_order_relaxed);
+        while (true) {
+            Cell & cell = cells[pos & mask];
+            std::size_t sequence = cell.sequence.load(std::memory_order_acquire);
+            std::intptr_t diff = static_cast<std::intptr_t>(sequence) - static_cast<std::intptr_t>(pos);
+            if (diff == 0) {
+                if (enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    cell.data = std::move(value);
+                    cell.sequence.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                // the cell still holds the item from the previous lap, full
+                return false;
+            } else {
+                pos = enqueue_pos.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    bool try_pop(T & value) {
+        std::size_t pos = dequeue_pos.load(std::memory_order_relaxed);
+        while (true) {
+            Cell & cell = cells[pos & mask];
+            std::size_t sequence = cell.sequence.load(std::memory_order_acquire);
+            std::intptr_t diff = static_cast<std::intptr_t>(sequence) - static_cast<std::intptr_t>(pos + 1);
+            if (diff == 0) {
+                if (dequeue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    value = std::move(cell.data);
+                    cell.sequence.store(pos + mask + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                // nothing has been pushed into the cell for this lap yet, empty
+                return false;
+            } else {
+                pos = dequeue_pos.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    /**
+    * \brief Waits for a free cell, must not be called after close().
+    */
+    void push(T value) {
+        if (!try_push(value)) {
+            full_waits.fetch_add(1, std::memory_order_relaxed);
+            Backoff backoff;
+            do {
+                if (!backoff.spin()) {
+                    block(blocked_pushes, not_full, [this] { return may_push(); });
+                }
+            } while (!try_push(value));
+        }
+        record_push();
+        signal(blocked_pops, not_empty);
+    }
+
+    /**
+    * \brief Waits for an item, false once the queue is closed and empty.
+    */
+    bool pop(T & value) {
+        return pop(value, [] { return false; });
+    }
+
+    /**
+    * \brief pop() that calls `idle` while it waits, `idle` returns true if it
+    * found something else to do, and the wait starts over.
+    *
+    * A blocked pop() only calls `idle` again once notify_idle() is called.
+    */
+    template <typename Idle>
+    bool pop(T & value, Idle && idle) {
+        if (try_pop(value)) {
+            signal(blocked_pushes, not_full);
+            return true;
+        }
+        empty_waits.fetch_add(1, std::memory_order_relaxed);
+        Backoff backoff;
+        while (true) {
+            if (closed.load(std::memory_order_acquire)) {
+                // everything pushed before close() is visible now
+                return try_pop(value);
+            }
+            // read before idle(), so work given to it after it looked is not slept through
+            std::uint64_t round = idle_round.load(std::memory_order_relaxed);
+            if (idle()) {
+                backoff = Backoff();
+            } else if (!backoff.spin()) {
+                block(blocked_pops, not_empty, [&] {
+                    return may_pop() || closed.load(std::memory_order_relaxed) || idle_round.load(std::memory_order_relaxed) != round;
+                });
+            }
+            if (try_pop(value)) {
+                signal(blocked_pushes, not_full);
+                return true;
+            }
+        }
+    }
+
+    /**
+    * \brief Wakes every blocked pop() so it calls its `idle` again.
+    */
+    void notify_idle() {
+        std::lock_guard<std::mutex> lock(wait_mutex);
+        idle_round.fetch_add(1, std::memory_order_relaxed);
+        not_empty.notify_all();
+    }
+
+    /**
+    * \brief Marks the end of the input, call once every producer is done.
+    */
+    void close() {
+        closed.store(true, std::memory_order_release);
+        std::lock_guard<std::mutex> lock(wait_mutex);
+        not_empty.notify_all();
+    }
+
+    std::size_t depth() const {
+        return enqueue_pos.load(std::memory_order_relaxed) - dequeue_pos.load(std::memory_order_relaxed);
+    }
+
+    Stats stats() const {
+        Stats s;
+        s.capacity = mask + 1;
+        s.pushes = pushes.load();
+        s.max_depth = max_depth.load();
+        s.mean_depth = s.pushes == 0 ? 0 : static_cast<double>(depth_sum.load()) / s.pushes;
+        s.full_waits = full_waits.load();
+        s.empty_waits = empty_waits.load();
+        return s;
+    }
+};
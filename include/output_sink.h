@@ -0,0 +1,138 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <mutex>
+#include <string>
+#include <type_traits>
+
+/**
+* \brief A file descriptor shared by many threads, each write() lands in one piece.
+*
+* Whatever was printed through std::cout or stdio before is flushed first, so
+* the two stay in order as long as std::cout is not used while another thread
+* writes here.
+*/
+class OutputSink {
+    int fd;
+    std::mutex mutex;
+
+    bool write_locked(const char * data, std::size_t length);
+
+    public:
+
+    explicit OutputSink(int fd);
+
+    OutputSink(const OutputSink &) = delete;
+    OutputSink & operator=(const OutputSink &) = delete;
+
+    bool write(const char * data, std::size_t length);
+
+    /**
+    * \brief Writes `length` bytes of the file `in_fd` from `offset` with sendfile(),
+    * so they never pass through user space.
+    *
+    * False if nothing was written because the kernel can not send between these
+    * two files, or on a system without sendfile(), the caller then writes the bytes itself.
+    */
+    bool write_file(int in_fd, std::uint64_t offset, std::uint64_t length);
+};
+
+/**
+* \brief The output of one thread, collected in a large buffer and handed to an
+* OutputSink with a single write() once it is full or flushed.
+*
+* While capturing, the buffer is never written out and grows as needed, until
+* end_capture() hands everything collected to the caller.
+*/
+class OutputBuffer {
+    OutputSink & sink;
+    std::string buffer;
+    std::size_t capacity;
+    bool capturing = false;
+
+    public:
+
+    explicit OutputBuffer(OutputSink & sink, std::size_t capacity = 256*1024);
+
+    /**
+    * \brief Calls flush().
+    */
+    ~OutputBuffer();
+
+    OutputBuffer(const OutputBuffer &) = delete;
+    OutputBuffer & operator=(const OutputBuffer &) = delete;
+
+    OutputBuffer & write(const char * data, std::size_t length) {
+        if (!capturing && buffer.size() + length > capacity) {
+            flush();
+            if (length > capacity) {
+                sink.write(data, length);
+                return *this;
+            }
+        }
+        buffer.append(data, length);
+        return *this;
+    }
+
+    /**
+    * \brief Writes [first, last) as one span if the iterators point into contiguous memory.
+    */
+    template <typename It>
+    OutputBuffer & write_range(It first, It last) {
+        if constexpr (std::is_pointer<It>::value || std::is_same<It, std::string::iterator>::value || std::is_same<It, std::string::const_iterator>::value) {
+            if (first != last) write(&*first, static_cast<std::size_t>(last - first));
+        } else {
+            for (; first != last; ++first) put(*first);
+        }
+        return *this;
+    }
+
+    OutputBuffer & put(char c) {
+        if (!capturing && buffer.size() == capacity) flush();
+        buffer.push_back(c);
+        return *this;
+    }
+
+    OutputBuffer & operator << (const std::string & s) {
+        return write(s.data(), s.size());
+    }
+
+    OutputBuffer & operator << (const char * s) {
+        return write(s, std::char_traits<char>::length(s));
+    }
+
+    OutputBuffer & operator << (char c) {
+        return put(c);
+    }
+
+    /**
+    * \brief Writes everything collected so far, then part of a file as
+    * OutputSink::write_file() does. False while capturing, or if the sink could
+    * not, the caller then writes the bytes itself.
+    */
+    bool write_file(int in_fd, std::uint64_t offset, std::uint64_t length);
+
+    /**
+    * \brief Writes everything collected so far, does nothing while capturing.
+    */
+    void flush();
+
+    /**
+    * \brief Keeps everything written from now on in the buffer, after writing what came before.
+    */
+    void begin_capture();
+
+    /**
+    * \brief Moves everything collected since begin_capture() into `text` and stops capturing.
+    */
+    void end_capture(std::string & text);
+
+    /**
+    * \brief Stops capturing and writes out everything collected instead.
+    */
+    void stop_capture();
+
+    bool is_capturing() const;
+};
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#ifndef _WIN32
+#include <sys/uio.h>
+#else
+struct iovec {
+    void * iov_base;
+    std::size_t iov_len;
+};
+#endif
+
+/**
+* \brief Writes a file that is mostly made of unchanged regions of another file.
+*
+* Unchanged regions of the source are described by their offset and length,
+* replacement text is passed as bytes. Everything is batched into `writev(2)`
+* calls, and regions of at least `copy_threshold` bytes are copied kernel side
+* with `copy_file_range(2)` so they never pass through user space.
+*
+* Output goes to the current file position of `out_fd`, or to `out_offset`
+* onwards (with `pwritev(2)`) if one is given, which lets several writers fill
+* disjoint parts of the same file.
+*
+* \note `src_data` must map the whole source, it is used for short regions and
+*       whenever the kernel cannot copy between the two files.
+*/
+class OutputWriter {
+    int out_fd;
+    int src_fd;
+    const char * src_data;
+    std::int64_t out_offset;
+
+    std::vector<iovec> iov;
+    std::vector<char> scratch;
+    std::size_t scratch_used = 0;
+
+    std::uint64_t total = 0;
+    bool failed = false;
+    bool kernel_copy = true;
+
+    void push(const char * data, std::size_t length);
+    bool write_iov();
+    bool copy_range(std::size_t offset, std::size_t length);
+
+    public:
+
+    static const std::size_t copy_threshold;
+
+    OutputWriter(int out_fd, int src_fd, const char * src_data, std::int64_t out_offset = -1);
+    ~OutputWriter();
+
+    OutputWriter(const OutputWriter & other) = delete;
+    OutputWriter & operator=(const OutputWriter & other) = delete;
+
+    /**
+    * \brief Appends `length` bytes of the source starting at `offset`.
+    */
+    void copy(std::size_t offset, std::size_t length);
+
+    /**
+    * \brief Appends a copy of `data`, the caller may reuse `data` right away.
+    */
+    void write(const char * data, std::size_t length);
+
+    /**
+    * \brief Appends `data` without copying it, it must stay valid until the next flush().
+    */
+    void write_stable(const char * data, std::size_t length);
+
+    bool flush();
+
+    bool ok() const;
+    std::uint64_t written() const;
+};
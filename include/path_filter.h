@@ -0,0 +1,110 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+
+/**
+* \brief A shell style wildcard pattern, as used by .gitignore.
+*
+* `*` matches any run of characters except `/`, `?` any single character except
+* `/`, `[...]` a character class (negated with `!` or `^`), `**` any run of
+* characters including `/`, `**` followed by `/` zero or more whole directories,
+* and `\` escapes the next character.
+*
+* Plain names and `*.ext` patterns, the bulk of every ignore file, are matched
+* with a single comparison instead of the general matcher.
+*/
+class Glob {
+    enum Kind {
+        LITERAL,
+        // `*` followed by literal text without a `/`
+        SUFFIX,
+        GENERIC
+    };
+
+    std::string pattern;
+    std::string literal;
+    Kind kind;
+
+    public:
+
+    Glob(const std::string & pattern);
+
+    bool matches(const char * text, std::size_t length) const;
+
+    const std::string & get_pattern() const;
+};
+
+/**
+* \brief The rules of the ignore files of one directory, linked to the rules
+* of the directories above it.
+*/
+struct IgnoreLevel {
+    struct Rule {
+        Glob glob;
+        // a `!` rule, matching entries are not ignored after all
+        bool negate;
+        // a rule ending in `/`, only matches directories
+        bool directory_only;
+        // a rule containing a `/`, matched against the path relative to `base` instead of the name
+        bool anchored;
+    };
+
+    std::shared_ptr<const IgnoreLevel> parent;
+    // the directory the rules were read from
+    std::string base;
+    std::vector<Rule> rules;
+};
+
+/**
+* \brief Decides which entries a directory walk skips, directories it skips
+* are pruned with everything below them.
+*
+* Entries are skipped if they match an `--exclude` glob, if they are ignored by
+* a `.gitignore` or `.ignore` file of their directory or a directory above it
+* within the walk (the deepest matching rule wins, `.ignore` over `.gitignore`),
+* or if they are files that do not match any `--include` glob while there are
+* some. With ignore files honored, `.git` directories are skipped as well.
+*
+* A glob without a `/` is matched against the name of the entry, one with a `/`
+* against its path relative to the directory the walk started in, or for ignore
+* file rules the directory of the ignore file.
+*/
+class PathFilter {
+    std::vector<IgnoreLevel::Rule> includes;
+    std::vector<IgnoreLevel::Rule> excludes;
+    bool ignore_files = true;
+
+    static bool matches(const IgnoreLevel::Rule & rule, const std::string & path, std::size_t base_length, std::size_t name_offset, bool is_directory);
+
+    bool load(IgnoreLevel & level, const std::string & path, int dir_fd, const char * name) const;
+
+    public:
+
+    /**
+    * \brief Globs use the syntax of ignore file lines, one ending in `/` only matches directories.
+    */
+    void include(const std::string & glob);
+    void exclude(const std::string & glob);
+    void use_ignore_files(bool use);
+
+    /**
+    * \brief The rules for the entries of the directory `path`, a new level if it has
+    * ignore files of its own, otherwise `parent`. `parent` is nullptr for the
+    * directory the walk starts in.
+    *
+    * `dir_fd`, if not -1, is an open descriptor of `path` the ignore files are
+    * opened relative to.
+    */
+    std::shared_ptr<const IgnoreLevel> enter(const std::shared_ptr<const IgnoreLevel> & parent, const std::string & path, int dir_fd = -1) const;
+
+    /**
+    * \brief True if the entry at `path`, whose name starts at `name_offset`, should
+    * not be walked into or scanned.
+    *
+    * `root_length` is the length of the path of the directory the walk started in.
+    */
+    bool skip(const IgnoreLevel * level, const std::string & path, std::size_t name_offset, std::size_t root_length, bool is_directory) const;
+};
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <regex>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+/**
+* \brief A replacement format string compiled into literal chunks and group references.
+*
+* Understands the same syntax as `std::regex_replace` with `format_default`:
+* `$$` is a literal `$`, `$&` the whole match, `` $` `` and `$'` the text before
+* and after the match, and `$n` / `$nn` the n-th capture group.
+*
+* Compiling once and applying the result to every match avoids re-parsing the
+* format string per match, which `std::match_results::format` does.
+*/
+class ReplacementTemplate {
+    public:
+
+    static const int LITERAL = -1;
+    static const int PREFIX = -2;
+    static const int SUFFIX = -3;
+
+    struct Chunk {
+        // a capture group, or LITERAL for text[offset, offset+length), or PREFIX/SUFFIX
+        int group;
+        std::size_t offset;
+        std::size_t length;
+    };
+
+    private:
+
+    std::string text;
+    std::vector<Chunk> chunks;
+    bool literal = true;
+
+    public:
+
+    ReplacementTemplate();
+
+    /**
+    * \brief Compiles `format`, `$n` refers to capture group `group_offset + n`.
+    */
+    ReplacementTemplate(const std::string & format, std::size_t group_offset = 0);
+
+    /**
+    * \brief True if the replacement does not depend on the match.
+    */
+    bool is_literal() const;
+
+    /**
+    * \brief The replacement text, only meaningful if is_literal().
+    */
+    const std::string & literal_text() const;
+
+    const std::vector<Chunk> & get_chunks() const;
+
+    /**
+    * \brief Emits the replacement of `m` as a sequence of `emit(data, length, stable)` calls.
+    *
+    * `stable` is true if `data` points into the template or into the searched
+    * text itself, false if it points to a temporary that is gone after `emit` returns.
+    */
+    template <typename BiDirIt, typename Emit>
+    void apply(const std::match_results<BiDirIt> & m, Emit && emit) const {
+        for (auto & chunk : chunks) {
+            if (chunk.group == LITERAL) {
+                emit(text.data() + chunk.offset, chunk.length, true);
+                continue;
+            }
+            const std::sub_match<BiDirIt> & sub = chunk.group == PREFIX ? m.prefix() : chunk.group == SUFFIX ? m.suffix() : m[chunk.group];
+            if (!sub.matched || sub.first == sub.second) continue;
+            if constexpr (std::is_pointer<BiDirIt>::value) {
+                emit(&*sub.first, static_cast<std::size_t>(sub.second - sub.first), true);
+            } else {
+                std::string s = sub.str();
+                emit(s.data(), s.size(), false);
+            }
+        }
+    }
+
+    template <typename BiDirIt>
+    void format(const std::match_results<BiDirIt> & m, std::string & out) const {
+        apply(m, [&](const char * data, std::size_t length, bool) { out.append(data, length); });
+    }
+
+    template <typename BiDirIt>
+    std::string format(const std::match_results<BiDirIt> & m) const {
+        std::string out;
+        format(m, out);
+        return out;
+    }
+};
@@ -0,0 +1,185 @@
+#pragma once
+
+#include <mpmc_queue.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <queue>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+/**
+* \brief Scans files in stages that run at the same time, connected by bounded queues.
+*
+* The walk stage, whoever calls submit(), hands over paths. The open stage
+* opens each file and asks the kernel to start reading it ahead, so its data is
+* on the way while the files before it are scanned. The scan stage runs `scan`
+* on the file the open stage opened, which collects everything printed for a
+* file, and the emit stage writes that output with `emit`, one file at a time.
+*
+* Each queue holds a limited number of items, a stage that gets ahead of the
+* next one waits, and print_stats() shows how full every queue ran.
+*
+* With `largest_first`, submitted files are held in a queue without a limit,
+* ordered by size, and a dispatch stage always passes on the largest one, so the
+* walk can run ahead and a large file found late still starts early. `ordered`
+* is ignored then, keeping the output in submission order would hold the walk
+* back to a window of files again.
+*
+* A scan can split its work with parallel_for(), scanners waiting for the next
+* file take part of that work instead of idling.
+*
+* With `ordered`, every file is numbered as it is submitted and the emit stage
+* holds back the output of a file until the output of every file before it is
+* emitted, so the output is in submission order whatever order the scans finish
+* in. submit() waits while a file would be more than a window of files ahead of
+* the last one emitted, which bounds what is held back. Without it, output is
+* emitted as soon as each scan finishes.
+*
+* A scan with a lot to print can call take_turn() and, once it is its turn,
+* write the rest of its output itself instead of collecting it for the emit stage.
+*/
+class ScanPipeline {
+    public:
+
+    /**
+    * \brief Scans `path`, with `fd` the file opened for reading by the open stage,
+    * or -1 if it could not be opened there. The pipeline closes `fd` afterwards.
+    */
+    using Scan = std::function<void(const std::string & path, int fd, std::string & output)>;
+    using Emit = std::function<void(const std::string & output)>;
+
+    private:
+
+    Scan scan;
+    Emit emit;
+
+    // a path to open and scan, or the output of a scan, numbered in submission order
+    struct Item {
+        std::uint64_t sequence;
+        std::string text;
+        // the path opened by the open stage, -1 before or if it could not be
+        int fd = -1;
+    };
+
+    struct BySize {
+        bool operator()(const std::pair<std::uint64_t, Item> & a, const std::pair<std::uint64_t, Item> & b) const {
+            return a.first < b.first;
+        }
+    };
+
+    struct Job {
+        const std::function<void(std::size_t)> * task;
+        std::size_t count;
+        std::atomic<std::size_t> next {0};
+        std::atomic<std::size_t> done {0};
+        // signalled when the last task is done
+        std::mutex done_mutex;
+        std::condition_variable all_done;
+    };
+
+    std::mutex jobs_mutex;
+    std::vector<std::shared_ptr<Job>> jobs;
+
+    bool largest_first;
+    std::mutex sized_mutex;
+    std::condition_variable sized_available;
+    std::priority_queue<std::pair<std::uint64_t, Item>, std::vector<std::pair<std::uint64_t, Item>>, BySize> sized;
+    bool sized_closed = false;
+    std::size_t sized_max = 0;
+    std::thread dispatcher;
+
+    bool ordered;
+    std::uint64_t window;
+    std::atomic<std::uint64_t> submitted {0};
+    std::mutex order_mutex;
+    std::condition_variable order_advanced;
+    // the number of items emitted, or skipped for having no output, in order
+    std::uint64_t emitted = 0;
+    std::uint64_t window_waits = 0;
+    std::size_t held_max = 0;
+    std::size_t held_bytes_max = 0;
+    std::atomic<std::uint64_t> turns {0};
+
+    MPMCQueue<Item> paths;
+    MPMCQueue<Item> opened;
+    MPMCQueue<Item> results;
+
+    std::vector<std::thread> openers;
+    std::vector<std::thread> scanners;
+    std::thread emitter;
+    bool finished = false;
+
+    void dispatch_stage();
+    void open_stage();
+    void scan_stage();
+    void emit_stage();
+
+    static void run_job(Job & job);
+    bool help();
+
+    std::uint64_t next_sequence();
+
+    public:
+
+    ScanPipeline(std::size_t openers, std::size_t scanners, Scan scan, Emit emit, bool largest_first = false, bool ordered = false);
+
+    /**
+    * \brief Calls finish().
+    */
+    ~ScanPipeline();
+
+    ScanPipeline(const ScanPipeline &) = delete;
+    ScanPipeline & operator=(const ScanPipeline &) = delete;
+
+    /**
+    * \brief Queues `path` to be scanned, waits while the pipeline is full, or
+    * with `ordered` while `path` would be too far ahead of the output.
+    *
+    * `size` is only used with `largest_first`, which never waits for a full pipeline.
+    */
+    void submit(std::string path, std::uint64_t size = 0);
+
+    /**
+    * \brief Queues output that needs no scan, emitted in its place among the submitted files.
+    */
+    void submit_output(std::string output);
+
+    /**
+    * \brief Runs `task(0) .. task(count-1)` on the calling thread and on any
+    * scanner that is waiting for a file, returns once all have finished.
+    */
+    void parallel_for(std::size_t count, const std::function<void(std::size_t)> & task);
+
+    /**
+    * \brief True if the calling thread is a scanner of a ScanPipeline.
+    */
+    static bool on_scanner();
+
+    /**
+    * \brief From a scan, true if the output of every file submitted before the one
+    * being scanned has been emitted. The scan may then write its output itself, the
+    * output of the files after it is held back until it returns.
+    *
+    * Never waits, a scan that is not given its turn keeps collecting its output,
+    * so a slow file does not hold up the scans of the files after it. Always false
+    * without `ordered`, which `largest_first` also turns off.
+    */
+    bool take_turn();
+
+    /**
+    * \brief Waits for every submitted file to be scanned and emitted, nothing may
+    * be submitted afterwards.
+    */
+    void finish();
+
+    void print_stats(std::ostream & out) const;
+};
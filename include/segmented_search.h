@@ -0,0 +1,86 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <regex>
+#include <vector>
+
+struct SegmentMatch {
+    std::size_t position;
+    std::size_t length;
+    // which search pattern produced the match
+    std::size_t pattern;
+};
+
+/**
+* \brief Searches a contiguous buffer in segments, one thread per segment, with
+* the same result as a single sequential search from the start.
+*
+* Every segment is searched up to `max_match_length` bytes past its end, so a
+* match that starts in a segment is always found by that segment. A match that
+* runs past the end of its segment invalidates the matches the next segment found
+* before its end, those are redone sequentially from where the match ended until
+* the rescan meets a match the next segment also found, from there on both agree.
+*
+* With `align_to_lines`, segments start right after a newline instead, for
+* patterns that never match across lines `max_match_length` may then be 0.
+*
+* \note `max_match_length` must be at least the length of the longest possible match.
+*/
+class SegmentedSearch {
+    public:
+
+    using Classify = std::function<std::size_t(const std::cmatch & m)>;
+
+    /**
+    * \brief Runs `task(0) .. task(count-1)`, possibly in parallel, and returns once all are done.
+    */
+    using ParallelFor = std::function<void(std::size_t count, const std::function<void(std::size_t)> & task)>;
+
+    private:
+
+    const char * data;
+    std::size_t length;
+    const std::regex & e;
+    std::size_t max_match_length;
+    bool align_to_lines;
+    Classify classify;
+
+    std::vector<SegmentMatch> matches;
+    std::vector<std::size_t> first_match;
+    std::vector<std::size_t> starts;
+
+    bool search_one(std::size_t from, std::size_t limit, bool retry, bool prev_avail, SegmentMatch & match) const;
+    bool search_next(SegmentMatch previous, bool first, std::size_t limit, SegmentMatch & match) const;
+    void search_segment(std::size_t from, std::size_t limit, bool first, std::vector<SegmentMatch> & out) const;
+
+    public:
+
+    SegmentedSearch(const char * data, std::size_t length, const std::regex & e, std::size_t max_match_length, bool align_to_lines, Classify classify);
+
+    /**
+    * \brief Splits the buffer into `segments` parts and searches them in parallel,
+    * with `parallel_for` if given, otherwise with a thread per segment.
+    */
+    void run(std::size_t segments, const ParallelFor & parallel_for = nullptr);
+
+    /**
+    * \brief All matches in order.
+    */
+    const std::vector<SegmentMatch> & get_matches() const;
+
+    /**
+    * \brief The number of segments of the last run().
+    */
+    std::size_t segment_count() const;
+
+    /**
+    * \brief The source range of segment `i`, the matches starting in it are
+    * `get_matches()[first_match_of(i) .. first_match_of(i+1))`.
+    *
+    * Segment ranges are adjusted so no match crosses from one segment into another.
+    */
+    std::size_t segment_begin(std::size_t i) const;
+    std::size_t segment_end(std::size_t i) const;
+    std::size_t first_match_of(std::size_t i) const;
+};
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
+
+/**
+* \brief A file or directory, identified by its device and inode.
+*/
+struct FileId {
+    std::uint64_t device;
+    std::uint64_t inode;
+
+    bool operator==(const FileId & other) const {
+        return device == other.device && inode == other.inode;
+    }
+};
+
+struct FileIdHash {
+    std::size_t operator()(const FileId & id) const {
+        return std::hash<std::uint64_t>()(id.inode * 0x9E3779B97F4A7C15ull ^ id.device);
+    }
+};
+
+/**
+* \brief A hash map many threads insert into at once.
+*
+* Keys are spread over a fixed number of shards by their hash, each with its
+* own lock, so threads only wait for each other when they hit the same shard.
+*/
+template <typename Key, typename Value, typename Hash = std::hash<Key>>
+class ShardedMap {
+    static const std::size_t SHARDS = 64;
+
+    struct Shard {
+        std::mutex mutex;
+        std::unordered_map<Key, Value, Hash> map;
+    };
+
+    Shard shards[SHARDS];
+    Hash hash;
+
+    public:
+
+    /**
+    * \brief Inserts `value` under `key` and returns true, or if `key` is already
+    * present leaves it alone, copies its value into `existing` and returns false.
+    */
+    bool insert(const Key & key, const Value & value, Value & existing) {
+        std::size_t h = hash(key);
+        // the low bits pick the bucket within the shard, use the high ones for the shard
+        Shard & shard = shards[(h >> 24) % SHARDS];
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto result = shard.map.emplace(key, value);
+        if (!result.second) {
+            existing = result.first->second;
+        }
+        return result.second;
+    }
+};
+
+/**
+* \brief A hash set many threads insert into at once, sharded as ShardedMap is.
+*/
+template <typename Key, typename Hash = std::hash<Key>>
+class ShardedSet {
+    static const std::size_t SHARDS = 64;
+
+    struct Shard {
+        std::mutex mutex;
+        std::unordered_set<Key, Hash> set;
+    };
+
+    Shard shards[SHARDS];
+    Hash hash;
+
+    public:
+
+    /**
+    * \brief Inserts `key` and returns true, or returns false if it is already present.
+    */
+    bool insert(const Key & key) {
+        std::size_t h = hash(key);
+        // the low bits pick the bucket within the shard, use the high ones for the shard
+        Shard & shard = shards[(h >> 24) % SHARDS];
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        return shard.set.insert(key).second;
+    }
+};
@@ -0,0 +1,20 @@
+#pragma once
+
+#include <cstdint>
+
+/**
+* \brief Copies everything that can be read from `in_fd` to `out_fd`, false on an error.
+*
+* On Linux a pipe is moved into the file with `splice` and a regular file is
+* copied with `copy_file_range`, so the data never passes through user space,
+* elsewhere or when the kernel refuses it is copied in large blocks.
+*
+* `copied` is set to the number of bytes written.
+*/
+bool spool(int in_fd, int out_fd, std::uint64_t & copied);
+
+/**
+* \brief An anonymous file that lives in memory, from `memfd_create`, or -1
+* where there is none. It can be opened again as `/proc/self/fd/<fd>`.
+*/
+int memory_file(const char * name);
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <regex>
+#include <vector>
+
+/**
+* \brief Searches a stream as it arrives, with the same result as a search of
+* the whole stream at once, keeping only a bounded window of it in memory.
+*
+* Data is read into a buffer and searched right away. A match is reported once
+* `max_match_length` bytes from where it starts have arrived, or with
+* `align_to_lines` once the line it starts in is complete, so no later data can
+* change it. The text between matches is reported as soon as no match can start
+* in it any more, and then dropped from the buffer.
+*
+* std::regex needs its input in one piece, so instead of wrapping around, the
+* buffer moves the part still needed to its front whenever it fills up. It only
+* grows for a line longer than itself with `align_to_lines`.
+*
+* \note `max_match_length` must be at least the length of the longest possible match.
+*/
+class StreamSearch {
+    public:
+
+    /**
+    * \brief Reads up to `size` bytes into `buffer`, returns the number read, 0 at
+    * the end of the stream or -1 on an error.
+    */
+    using Read = std::function<std::ptrdiff_t(char * buffer, std::size_t size)>;
+
+    /**
+    * \brief Receives the stream in order, each part as a match, with the match
+    * results, or as text between matches, with `match` null. A match can be empty.
+    */
+    using Span = std::function<void(const char * begin, const char * end, const std::cmatch * match)>;
+
+    /**
+    * \brief Called after the spans found in each block read, before the buffer
+    * they point into is reused, returns false to stop reading.
+    */
+    using Flush = std::function<bool()>;
+
+    private:
+
+    const std::regex & e;
+    std::size_t max_match_length;
+    bool align_to_lines;
+    std::size_t max_line_length;
+    std::vector<char> buffer;
+    std::uint64_t total = 0;
+    std::uint64_t long_lines = 0;
+
+    public:
+
+    /**
+    * \brief `capacity` is raised to hold a few times `max_match_length` if it is smaller.
+    */
+    StreamSearch(const std::regex & e, std::size_t max_match_length, bool align_to_lines, std::size_t capacity, std::size_t max_line_length);
+
+    /**
+    * \brief Searches everything `read` returns until the end of the stream, true
+    * if anything but an empty match matched, `read_failed` is set if the stream
+    * ended in an error.
+    */
+    bool run(const Read & read, const Span & span, const Flush & flush, bool & read_failed);
+
+    /**
+    * \brief The number of bytes read by run().
+    */
+    std::uint64_t size() const;
+
+    /**
+    * \brief The number of lines longer than `max_line_length` run() passed on without searching them.
+    */
+    std::uint64_t skipped_lines() const;
+};
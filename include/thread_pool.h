@@ -0,0 +1,82 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+* \brief A fixed set of worker threads, each with its own deque of tasks.
+*
+* A task submitted from a worker goes onto that worker's own deque, which the
+* worker takes from the back, so a directory's entries are processed depth first
+* by the thread that listed it. A worker that runs out of tasks steals from the
+* front of another worker's deque, which holds the oldest and usually largest
+* pieces of work.
+*
+* Tasks submitted from outside the pool are spread over the workers in turn.
+*/
+class ThreadPool {
+    public:
+
+    using Task = std::function<void()>;
+
+    private:
+
+    struct Worker {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::vector<std::thread> threads;
+
+    // tasks sitting in a deque, and tasks submitted but not yet finished
+    std::atomic<std::size_t> queued {0};
+    std::atomic<std::size_t> pending {0};
+    std::atomic<std::size_t> next_worker {0};
+
+    // guards sleeping, waking and waiting, never held while a task runs
+    std::mutex mutex;
+    std::condition_variable work_available;
+    std::condition_variable all_done;
+    bool stopping = false;
+
+    bool pop(std::size_t index, Task & task);
+    void run(std::size_t index);
+
+    public:
+
+    /**
+    * \brief Starts `threads` workers, at least one.
+    */
+    ThreadPool(std::size_t threads);
+
+    /**
+    * \brief Waits for all tasks and stops the workers.
+    */
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool & operator=(const ThreadPool &) = delete;
+
+    void submit(Task task);
+
+    /**
+    * \brief Blocks until every submitted task, including tasks submitted by
+    * other tasks, has finished. Must not be called from a worker.
+    */
+    void wait();
+
+    std::size_t size() const;
+
+    /**
+    * \brief True if the calling thread is a worker of any ThreadPool.
+    */
+    static bool on_worker();
+};
@@ -0,0 +1,252 @@
+#include <atomic_file.h>
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <atomic>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <io.h>
+#define AF_OPEN _open
+#define AF_CLOSE _close
+#define AF_WRITE _write
+#else
+#include <unistd.h>
+#include <climits>
+#define AF_OPEN ::open
+#define AF_CLOSE ::close
+#define AF_WRITE ::write
+#endif
+
+static std::string directory_of(const std::string & path) {
+    auto slash = path.find_last_of(
+#ifdef _WIN32
+        "/\\"
+#else
+        '/'
+#endif
+    );
+    if (slash == std::string::npos) return ".";
+    if (slash == 0) return "/";
+    return path.substr(0, slash);
+}
+
+static std::string unique_name(const std::string & path) {
+    static std::atomic<unsigned long> counter {0};
+    return path + ".FindReplace__" + std::to_string(
+#ifdef _WIN32
+        GetCurrentProcessId()
+#else
+        getpid()
+#endif
+    ) + "_" + std::to_string(counter++);
+}
+
+AtomicFile::AtomicFile(const char * path) {
+#ifdef _WIN32
+    this->path = path;
+    struct _stat st;
+    if (_stat(path, &st) == -1) {
+        std::cerr << "failed to stat file: " << path << ": " << strerror(errno) << std::endl;
+        return;
+    }
+    tmp_path = unique_name(this->path);
+    fd = AF_OPEN(tmp_path.c_str(), _O_WRONLY | _O_CREAT | _O_EXCL | _O_BINARY, st.st_mode & (_S_IREAD | _S_IWRITE));
+    if (fd == -1) {
+        std::cerr << "failed to create temporary file in " << directory_of(this->path) << ": " << strerror(errno) << std::endl;
+        tmp_path.clear();
+    }
+#else
+    // replace the file a symlink points to, not the symlink itself
+    char resolved[PATH_MAX];
+    this->path = realpath(path, resolved) != nullptr ? resolved : path;
+
+    struct stat st;
+    if (stat(this->path.c_str(), &st) == -1) {
+        std::cerr << "failed to stat file: " << path << ": " << strerror(errno) << std::endl;
+        return;
+    }
+#ifdef O_TMPFILE
+    fd = AF_OPEN(directory_of(this->path).c_str(), O_TMPFILE | O_WRONLY | O_CLOEXEC, st.st_mode & 07777);
+    anonymous = fd != -1;
+#endif
+    if (fd == -1) {
+        // O_TMPFILE is not supported by every filesystem, fall back to a named file
+        tmp_path = unique_name(this->path) + "_XXXXXX";
+        fd = mkstemp(&tmp_path[0]);
+    }
+    if (fd == -1) {
+        std::cerr << "failed to create temporary file in " << directory_of(this->path) << ": " << strerror(errno) << std::endl;
+        tmp_path.clear();
+        return;
+    }
+    fchmod(fd, st.st_mode & 07777);
+    if (fchown(fd, st.st_uid, st.st_gid) == -1) {
+        // only root may give files away, but we can still keep the group if we belong to it
+        if (fchown(fd, -1, st.st_gid) == -1) {}
+    }
+#endif
+}
+
+AtomicFile::~AtomicFile() {
+    discard();
+}
+
+bool AtomicFile::is_open() const {
+    return fd != -1;
+}
+
+int AtomicFile::get_fd() const {
+    return fd;
+}
+
+const std::string & AtomicFile::get_path() const {
+    return path;
+}
+
+void AtomicFile::close_fd() {
+    if (fd != -1) {
+        AF_CLOSE(fd);
+        fd = -1;
+    }
+}
+
+bool AtomicFile::link_anonymous() {
+#if !defined(_WIN32) && defined(O_TMPFILE)
+    // linkat(fd, "", ..., AT_EMPTY_PATH) requires CAP_DAC_READ_SEARCH, going through /proc does not
+    std::string proc_path = "/proc/self/fd/" + std::to_string(fd);
+    while (true) {
+        tmp_path = unique_name(path);
+        if (linkat(AT_FDCWD, proc_path.c_str(), AT_FDCWD, tmp_path.c_str(), AT_SYMLINK_FOLLOW) == 0) {
+            return true;
+        }
+        if (errno == EEXIST) continue;
+        std::cerr << "failed to link temporary file for " << path << ": " << strerror(errno) << std::endl;
+        tmp_path.clear();
+        return false;
+    }
+#else
+    return false;
+#endif
+}
+
+bool AtomicFile::commit() {
+    if (fd == -1) return false;
+
+#ifdef _WIN32
+    close_fd();
+    if (!MoveFileExA(tmp_path.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH)) {
+        std::cerr << "failed to replace file: " << path << std::endl;
+        discard();
+        return false;
+    }
+#else
+    // the data must reach the disk before the rename does, or a crash could leave an empty file
+    while (fdatasync(fd) == -1) {
+        if (errno == EINTR) continue;
+        std::cerr << "failed to sync temporary file for " << path << ": " << strerror(errno) << std::endl;
+        discard();
+        return false;
+    }
+    if (anonymous && !link_anonymous()) {
+        discard();
+        return false;
+    }
+    close_fd();
+    if (rename(tmp_path.c_str(), path.c_str()) == -1) {
+        std::cerr << "failed to replace file: " << path << ": " << strerror(errno) << std::endl;
+        discard();
+        return false;
+    }
+#endif
+    tmp_path.clear();
+    // the rename itself is only on the disk once the directory holding it is
+    if (!sync_directory()) {
+        std::cerr << "failed to sync directory of " << path << ": " << strerror(errno) << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool AtomicFile::sync_directory() {
+#ifdef _WIN32
+    // MOVEFILE_WRITE_THROUGH already waited for the rename to reach the disk
+    return true;
+#else
+    int dir_fd = AF_OPEN(directory_of(path).c_str(), O_RDONLY | O_DIRECTORY);
+    if (dir_fd == -1) return false;
+    bool synced;
+    while (!(synced = fsync(dir_fd) == 0) && errno == EINTR) {}
+    int saved = errno;
+    AF_CLOSE(dir_fd);
+    errno = saved;
+    return synced;
+#endif
+}
+
+void AtomicFile::discard() {
+    close_fd();
+    if (!tmp_path.empty()) {
+#ifdef _WIN32
+        _unlink(tmp_path.c_str());
+#else
+        unlink(tmp_path.c_str());
+#endif
+        tmp_path.clear();
+    }
+}
+
+FdStreamBuffer::FdStreamBuffer(int fd, std::size_t buffer_size) : fd(fd), buffer(buffer_size) {
+    setp(buffer.data(), buffer.data() + buffer.size());
+}
+
+FdStreamBuffer::~FdStreamBuffer() {
+    sync();
+}
+
+bool FdStreamBuffer::write_all(const char * data, std::size_t size) {
+    while (size != 0) {
+        auto w = AF_WRITE(fd, data, size);
+        if (w == -1) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        data += w;
+        size -= w;
+    }
+    return true;
+}
+
+FdStreamBuffer::int_type FdStreamBuffer::overflow(int_type c) {
+    if (sync() == -1) return traits_type::eof();
+    if (!traits_type::eq_int_type(c, traits_type::eof())) {
+        *pptr() = traits_type::to_char_type(c);
+        pbump(1);
+    }
+    return traits_type::not_eof(c);
+}
+
+std::streamsize FdStreamBuffer::xsputn(const char * s, std::streamsize n) {
+    if (n >= static_cast<std::streamsize>(epptr() - pptr())) {
+        // large writes bypass the buffer
+        if (sync() == -1 || !write_all(s, n)) return 0;
+        return n;
+    }
+    std::memcpy(pptr(), s, n);
+    pbump(n);
+    return n;
+}
+
+int FdStreamBuffer::sync() {
+    auto size = pptr() - pbase();
+    if (size == 0) return 0;
+    bool ok = write_all(pbase(), size);
+    setp(buffer.data(), buffer.data() + buffer.size());
+    return ok ? 0 : -1;
+}
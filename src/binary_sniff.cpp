@@ -0,0 +1,41 @@
+#include <binary_sniff.h>
+
+#include <cstdint>
+#include <cstring>
+
+static const std::uint64_t ONES = 0x0101010101010101ull;
+static const std::uint64_t HIGHS = 0x8080808080808080ull;
+
+// control characters text is made of too
+static bool is_text_control(unsigned char c) {
+    return c == '\t' || c == '\n' || c == '\v' || c == '\f' || c == '\r' || c == '\b' || c == 0x1B;
+}
+
+bool looks_binary(const char * data, std::size_t length) {
+    auto bytes = reinterpret_cast<const unsigned char *>(data);
+
+    // UTF-16 is mostly NUL bytes when it holds ASCII, its byte order mark tells it apart
+    if (length >= 2 && ((bytes[0] == 0xFF && bytes[1] == 0xFE) || (bytes[0] == 0xFE && bytes[1] == 0xFF))) {
+        return false;
+    }
+
+    std::size_t controls = 0;
+    std::size_t i = 0;
+    while (i < length) {
+        // eight bytes at a time, none of them below 0x20
+        if (i + 8 <= length) {
+            std::uint64_t word;
+            memcpy(&word, bytes + i, 8);
+            if (((word - ONES * 0x20) & ~word & HIGHS) == 0) {
+                i += 8;
+                continue;
+            }
+        }
+
+        unsigned char c = bytes[i];
+        if (c == 0) return true;
+        if (c < 0x20 && !is_text_control(c)) controls++;
+        i++;
+    }
+    return controls * BINARY_CONTROL_RATIO > length;
+}
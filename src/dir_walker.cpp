@@ -0,0 +1,123 @@
+#include <dir_walker.h>
+
+#ifdef __linux__
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// the layout getdents64 fills the buffer with
+struct linux_dirent64 {
+    std::uint64_t d_ino;
+    std::int64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+};
+
+// large enough to read most directories in a single call
+static const std::size_t BATCH_SIZE = 128*1024;
+
+DirWalker::DirWalker(int fd, const std::string & path, const FileId & id) : fd(fd), path(path), id(id) {}
+
+std::shared_ptr<DirWalker> DirWalker::from_fd(int fd, const std::string & path) {
+    struct stat st;
+    if (fstat(fd, &st) == -1) {
+        ::close(fd);
+        return nullptr;
+    }
+    FileId id = {static_cast<std::uint64_t>(st.st_dev), static_cast<std::uint64_t>(st.st_ino)};
+    return std::shared_ptr<DirWalker>(new DirWalker(fd, path, id));
+}
+
+DirWalker::~DirWalker() {
+    ::close(fd);
+}
+
+std::shared_ptr<DirWalker> DirWalker::open(const std::string & path) {
+    int fd = ::openat(AT_FDCWD, path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd == -1) return nullptr;
+    return from_fd(fd, path);
+}
+
+std::shared_ptr<DirWalker> DirWalker::open_child(const char * name) const {
+    int child = ::openat(fd, name, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (child == -1) return nullptr;
+    return from_fd(child, child_path(name));
+}
+
+const std::string & DirWalker::get_path() const {
+    return path;
+}
+
+int DirWalker::get_fd() const {
+    return fd;
+}
+
+const FileId & DirWalker::get_id() const {
+    return id;
+}
+
+std::string DirWalker::child_path(const char * name) const {
+    std::size_t name_length = strlen(name);
+    std::string child;
+    child.reserve(path.size() + 1 + name_length);
+    child.append(path);
+    child.push_back('/');
+    child.append(name, name_length);
+    return child;
+}
+
+bool DirWalker::for_each(const std::function<void(const char * name, Type type, const FileId & id)> & visit) const {
+    // not shared between walkers, visit may walk a sub directory before this one is done
+    std::vector<char> buffer(BATCH_SIZE);
+    while (true) {
+        long n = syscall(SYS_getdents64, fd, buffer.data(), buffer.size());
+        if (n == -1) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        if (n == 0) return true;
+        for (long offset = 0; offset < n; ) {
+            auto entry = reinterpret_cast<const linux_dirent64 *>(buffer.data() + offset);
+            offset += entry->d_reclen;
+            const char * name = entry->d_name;
+            if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) continue;
+            Type type;
+            FileId entry_id = {id.device, entry->d_ino};
+            switch (entry->d_type) {
+                case DT_REG: type = REGULAR; break;
+                case DT_DIR: type = DIRECTORY; break;
+                case DT_LNK:
+                case DT_UNKNOWN: {
+                    struct stat st;
+                    if (fstatat(fd, name, &st, 0) == -1) {
+                        type = MISSING;
+                        break;
+                    }
+                    // what a link points to may be anywhere
+                    entry_id = {static_cast<std::uint64_t>(st.st_dev), static_cast<std::uint64_t>(st.st_ino)};
+                    if (S_ISREG(st.st_mode)) {
+                        type = REGULAR;
+                    } else if (S_ISDIR(st.st_mode)) {
+                        type = DIRECTORY;
+                    } else {
+                        type = OTHER;
+                    }
+                    break;
+                }
+                default: type = OTHER; break;
+            }
+            visit(name, type, entry_id);
+        }
+    }
+}
+
+#endif
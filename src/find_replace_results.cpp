@@ -0,0 +1,141 @@
+// FindReplaceResults, prints what FindReplace --binary-results wrote
+
+#include <match_log.h>
+#include <output_sink.h>
+
+#include <charconv>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+static void help() {
+    puts("FindReplaceResults FILE [--count] [--files] [--path PATH] [--pattern N]");
+    puts("");
+    puts("prints the matches FindReplace --binary-results wrote to FILE, one per line as path:offset:length:pattern");
+    puts("");
+    puts("--count            only print the number of matches and files");
+    puts("--files            print every file with its number of matches instead of the matches");
+    puts("--path PATH        only the matches in PATH, may be given more than once");
+    puts("--pattern N        only the matches of search item N, counted from 0, may be given more than once");
+    puts("");
+    puts("no arguments       this help text");
+    puts("-h, --help         this help text");
+    exit(0);
+}
+
+static OutputBuffer & operator << (OutputBuffer & out, std::uint64_t value) {
+    char digits[24];
+    auto end = std::to_chars(digits, digits + sizeof(digits), value).ptr;
+    return out.write(digits, end - digits);
+}
+
+int main(int argc, const char ** argv) {
+    if (argc == 1) help();
+
+    const char * file = nullptr;
+    bool count_only = false;
+    bool per_file = false;
+    std::vector<const char *> wanted_paths;
+    std::vector<std::uint32_t> wanted_patterns;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-h") == 0 || strcmp(argv[i], "--help") == 0) {
+            help();
+        } else if (strcmp(argv[i], "--count") == 0) {
+            count_only = true;
+        } else if (strcmp(argv[i], "--files") == 0) {
+            per_file = true;
+        } else if (strcmp(argv[i], "--path") == 0 || strcmp(argv[i], "--pattern") == 0) {
+            if (i + 1 == argc) {
+                std::cout << argv[i] << " requires an argument" << std::endl;
+                return 1;
+            }
+            const char * value = argv[++i];
+            if (strcmp(argv[i-1], "--path") == 0) {
+                wanted_paths.push_back(value);
+            } else {
+                const char * value_end = value + strlen(value);
+                std::uint32_t pattern;
+                auto r = std::from_chars(value, value_end, pattern);
+                if (value == value_end || r.ec != std::errc() || r.ptr != value_end) {
+                    std::cout << "invalid --pattern: " << value << std::endl;
+                    return 1;
+                }
+                wanted_patterns.push_back(pattern);
+            }
+        } else if (file == nullptr) {
+            file = argv[i];
+        } else {
+            std::cout << "unknown argument: " << argv[i] << std::endl;
+            return 1;
+        }
+    }
+    if (file == nullptr) help();
+
+    MatchLogReader reader(file);
+    if (!reader.is_open()) {
+        std::cout << "failed to read " << file << ": " << reader.get_error() << std::endl;
+        return 1;
+    }
+
+    // which files and patterns are wanted, decided once instead of for every match
+    std::vector<char> path_wanted(reader.path_count(), wanted_paths.empty());
+    for (std::size_t i = 0; i < reader.path_count(); i++) {
+        for (auto path : wanted_paths) {
+            if (reader.path(i) == path) path_wanted[i] = 1;
+        }
+    }
+    auto pattern_wanted = [&](std::uint32_t pattern) {
+        if (wanted_patterns.empty()) return true;
+        for (auto p : wanted_patterns) {
+            if (p == pattern) return true;
+        }
+        return false;
+    };
+
+    OutputSink sink(1);
+    OutputBuffer out(sink);
+    std::uint64_t matches = 0;
+    std::vector<std::uint64_t> per_path(reader.path_count(), 0);
+    for (std::size_t b = 0; b < reader.block_count(); b++) {
+        auto block = reader.block(b);
+        for (std::size_t i = 0; i < block.count; i++) {
+            std::uint32_t f = block.file[i];
+            if (f >= reader.path_count()) {
+                std::cout << "broken file " << file << ": match with an unknown path" << std::endl;
+                return 1;
+            }
+            if (!path_wanted[f] || !pattern_wanted(block.pattern[i])) continue;
+            matches++;
+            per_path[f]++;
+            if (count_only || per_file) continue;
+            auto path = reader.path(f);
+            out.write(path.data(), path.size()).put(':') << block.offset[i];
+            out.put(':') << block.length[i];
+            out.put(':') << static_cast<std::uint64_t>(block.pattern[i]);
+            out.put('\n');
+        }
+    }
+
+    if (per_file) {
+        for (std::size_t f = 0; f < reader.path_count(); f++) {
+            if (per_path[f] == 0) continue;
+            auto path = reader.path(f);
+            out.write(path.data(), path.size()).put(':') << per_path[f];
+            out.put('\n');
+        }
+    }
+    if (count_only) {
+        std::uint64_t files = 0;
+        for (auto n : per_path) {
+            if (n != 0) files++;
+        }
+        out << matches;
+        out << " matches in ";
+        out << files;
+        out << " files\n";
+    }
+    out.flush();
+    return 0;
+}
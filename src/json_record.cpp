@@ -0,0 +1,137 @@
+#include <json_record.h>
+
+#include <charconv>
+
+JsonRecord::JsonRecord(OutputBuffer & out) : out(out) {
+    out.put('{');
+}
+
+void JsonRecord::name(const char * name) {
+    if (!first) out.put(',');
+    first = false;
+    out.put('"') << name;
+    out.write("\":", 2);
+}
+
+// the length of the valid UTF-8 sequence at data, 0 if there is none
+static std::size_t utf8_length(const unsigned char * data, std::size_t length) {
+    unsigned char c = data[0];
+    std::size_t n;
+    unsigned char min = 0x80, max = 0xBF;
+    if (c >= 0xC2 && c <= 0xDF) {
+        n = 2;
+    } else if (c >= 0xE0 && c <= 0xEF) {
+        n = 3;
+        // no overlong encodings and no surrogates
+        if (c == 0xE0) min = 0xA0;
+        if (c == 0xED) max = 0x9F;
+    } else if (c >= 0xF0 && c <= 0xF4) {
+        n = 4;
+        if (c == 0xF0) min = 0x90;
+        if (c == 0xF4) max = 0x8F;
+    } else {
+        return 0;
+    }
+    if (length < n || data[1] < min || data[1] > max) return 0;
+    for (std::size_t i = 2; i < n; i++) {
+        if (data[i] < 0x80 || data[i] > 0xBF) return 0;
+    }
+    return n;
+}
+
+// true if all of data is valid UTF-8
+static bool valid_utf8(const unsigned char * data, std::size_t length) {
+    std::size_t i = 0;
+    while (i < length) {
+        if (data[i] < 0x80) {
+            i++;
+            continue;
+        }
+        std::size_t n = utf8_length(data + i, length - i);
+        if (n == 0) return false;
+        i += n;
+    }
+    return true;
+}
+
+void JsonRecord::escape(const char * data, std::size_t length) {
+    static const char HEX[] = "0123456789abcdef";
+    auto bytes = reinterpret_cast<const unsigned char *>(data);
+    // runs of bytes that need no escaping are written in one piece
+    std::size_t run = 0;
+    for (std::size_t i = 0; i < length; i++) {
+        unsigned char c = bytes[i];
+        if ((c >= 0x20 && c != '"' && c != '\\') || c >= 0x80) continue;
+        out.write(data + run, i - run);
+        switch (c) {
+            case '"': out.write("\\\"", 2); break;
+            case '\\': out.write("\\\\", 2); break;
+            case '\n': out.write("\\n", 2); break;
+            case '\r': out.write("\\r", 2); break;
+            case '\t': out.write("\\t", 2); break;
+            default: {
+                char u[6] = {'\\', 'u', '0', '0', HEX[c >> 4], HEX[c & 0xF]};
+                out.write(u, sizeof(u));
+            }
+        }
+        run = i + 1;
+    }
+    out.write(data + run, length - run);
+}
+
+void JsonRecord::base64(const char * data, std::size_t length) {
+    static const char DIGITS[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    auto bytes = reinterpret_cast<const unsigned char *>(data);
+    std::size_t i = 0;
+    for (; i + 3 <= length; i += 3) {
+        std::uint32_t v = bytes[i] << 16 | bytes[i+1] << 8 | bytes[i+2];
+        char quad[4] = {DIGITS[v >> 18], DIGITS[v >> 12 & 63], DIGITS[v >> 6 & 63], DIGITS[v & 63]};
+        out.write(quad, 4);
+    }
+    if (i != length) {
+        std::uint32_t v = bytes[i] << 16 | (i + 1 < length ? bytes[i+1] << 8 : 0);
+        char quad[4] = {DIGITS[v >> 18], DIGITS[v >> 12 & 63], i + 1 < length ? DIGITS[v >> 6 & 63] : '=', '='};
+        out.write(quad, 4);
+    }
+}
+
+JsonRecord & JsonRecord::number(const char * name, std::uint64_t value) {
+    this->name(name);
+    char digits[24];
+    auto end = std::to_chars(digits, digits + sizeof(digits), value).ptr;
+    out.write(digits, end - digits);
+    return *this;
+}
+
+JsonRecord & JsonRecord::string(const char * name, const char * data, std::size_t length) {
+    this->name(name);
+    if (valid_utf8(reinterpret_cast<const unsigned char *>(data), length)) {
+        out.put('"');
+        escape(data, length);
+        out.put('"');
+    } else {
+        out.write("{\"bytes\":\"", 10);
+        base64(data, length);
+        out.write("\"}", 2);
+    }
+    return *this;
+}
+
+JsonRecord & JsonRecord::begin_string(const char * name) {
+    part_name = name;
+    parts.clear();
+    return *this;
+}
+
+JsonRecord & JsonRecord::string_part(const char * data, std::size_t length) {
+    parts.append(data, length);
+    return *this;
+}
+
+JsonRecord & JsonRecord::end_string() {
+    return string(part_name, parts.data(), parts.size());
+}
+
+void JsonRecord::end() {
+    out.write("}\n", 2);
+}
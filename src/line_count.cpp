@@ -0,0 +1,42 @@
+#include <line_count.h>
+
+#include <cstdint>
+#include <cstring>
+
+static const std::uint64_t ONES = 0x0101010101010101ull;
+static const std::uint64_t LOWS = 0x7F7F7F7F7F7F7F7Full;
+static const std::uint64_t NEWLINES = ONES * '\n';
+
+// 1 in every byte of word that is a newline, 0 in the others
+static std::uint64_t newline_bytes(std::uint64_t word) {
+    std::uint64_t x = word ^ NEWLINES;
+    // the high bit of a byte of x is set if the byte is not 0, without carries between bytes
+    return (~(((x & LOWS) + LOWS) | x | LOWS)) >> 7;
+}
+
+// adds up the bytes of counts, each at most 255
+static std::size_t sum_bytes(std::uint64_t counts) {
+    std::uint64_t pairs = (counts & 0x00FF00FF00FF00FFull) + ((counts >> 8) & 0x00FF00FF00FF00FFull);
+    return (pairs * 0x0001000100010001ull) >> 48;
+}
+
+std::size_t count_newlines(const char * data, std::size_t length) {
+    std::size_t count = 0;
+    std::size_t i = 0;
+    while (length - i >= 8) {
+        // a byte of counts can take 255 words before it overflows
+        std::size_t words = (length - i) / 8;
+        if (words > 255) words = 255;
+        std::uint64_t counts = 0;
+        for (std::size_t w = 0; w < words; w++, i += 8) {
+            std::uint64_t word;
+            memcpy(&word, data + i, 8);
+            counts += newline_bytes(word);
+        }
+        count += sum_bytes(counts);
+    }
+    for (; i < length; i++) {
+        if (data[i] == '\n') count++;
+    }
+    return count;
+}
@@ -0,0 +1,66 @@
+#include <locality_batch.h>
+
+#include <algorithm>
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <linux/fiemap.h>
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+#endif
+
+LocalityBatch::LocalityBatch(std::size_t batch_size, Sink sink) : batch_size(batch_size == 0 ? 1 : batch_size), sink(sink) {}
+
+void LocalityBatch::hand_on(std::vector<std::pair<std::uint64_t, std::string>> & batch) {
+    // stable, files with the same key keep the order they were found in
+    std::stable_sort(batch.begin(), batch.end(), [](const std::pair<std::uint64_t, std::string> & a, const std::pair<std::uint64_t, std::string> & b) {
+        return a.first < b.first;
+    });
+    for (auto & file : batch) {
+        sink(file.second);
+    }
+}
+
+void LocalityBatch::add(std::string path, std::uint64_t key) {
+    std::vector<std::pair<std::uint64_t, std::string>> batch;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        pending.emplace_back(key, std::move(path));
+        if (pending.size() < batch_size) return;
+        batch.swap(pending);
+    }
+    // outside the lock, the sink may wait for the scans to catch up
+    hand_on(batch);
+}
+
+void LocalityBatch::flush() {
+    std::vector<std::pair<std::uint64_t, std::string>> batch;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        batch.swap(pending);
+    }
+    hand_on(batch);
+}
+
+std::uint64_t first_physical_offset(const char * path) {
+#ifdef __linux__
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1) return UINT64_MAX;
+    // a struct fiemap followed by room for the single extent asked for
+    alignas(struct fiemap) char request[sizeof(struct fiemap) + sizeof(struct fiemap_extent)] = {};
+    auto map = reinterpret_cast<struct fiemap *>(request);
+    map->fm_start = 0;
+    map->fm_length = FIEMAP_MAX_OFFSET;
+    map->fm_extent_count = 1;
+    std::uint64_t offset = UINT64_MAX;
+    if (ioctl(fd, FS_IOC_FIEMAP, map) == 0 && map->fm_mapped_extents != 0) {
+        offset = map->fm_extents[0].fe_physical;
+    }
+    close(fd);
+    return offset;
+#else
+    (void)path;
+    return UINT64_MAX;
+#endif
+}
@@ -3,23 +3,52 @@
 #include <cppfs/FileIterator.h>
 
 #include <sstream>
+#include <charconv>
+#include <string_view>
 #include <fstream>
 
 #include <memory>
+#include <unordered_set>
 #include <cstring>
 
 #include <mmap_iterator.h>
 #include <ifstream_iterator.h>
 
 #include <tmpfile.h>
+#include <atomic_file.h>
+#include <output_writer.h>
+#include <replacement_template.h>
+#include <segmented_search.h>
+#include <thread_pool.h>
+#include <dir_walker.h>
+#include <scan_pipeline.h>
+#include <path_filter.h>
+#include <binary_sniff.h>
+#include <sharded_map.h>
+#include <locality_batch.h>
+#include <output_sink.h>
+#include <stream_search.h>
+#include <spool.h>
+#include <json_record.h>
+#include <match_log.h>
+#include <line_count.h>
+
+#include <mutex>
+#include <thread>
 
 #ifdef _WIN32
 #include <fileapi.h>
+#include <memoryapi.h>
+#include <io.h>
 #else
 #include <unistd.h>
 #include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
 #endif
 
+#include <fcntl.h>
+
 namespace DarcsPatch {
     // STD IMPL - LLDB by default will not step into std code, this is good EXCEPT if we want to step into DarcsPatch::function
     // stepping into DarcsPatch::function is required in order to step info our assigned function callback
@@ -187,15 +216,111 @@ bool print_lines = false;
 bool ignore_case = false;
 bool silent = false;
 bool use_mmap = true;
+bool in_place = false;
+bool use_regex = false;
+
+// --to-stdout, replaced contents are written to stdout instead of back into the file
+bool to_stdout = false;
+
+// where the replaced contents go with --to-stdout, everything else printed goes to stderr then
+int stdout_fd = 1;
+
+// --json, every match is printed to stdout as a JSON record, everything else goes to stderr
+bool json_output = false;
+
+// --binary-results, the file every match is recorded in and the log writing it, nullptr without it
+const char * binary_results_path = nullptr;
+MatchLog * match_log = nullptr;
+
+// worker threads used to scan files, and to process a single large file
+unsigned int jobs = std::max(1u, std::thread::hardware_concurrency());
+
+// walks directories when jobs > 1, nullptr otherwise
+ThreadPool * pool = nullptr;
+
+// opens, scans and prints the files the walk finds when jobs > 1, nullptr otherwise
+ScanPipeline * pipeline = nullptr;
+
+// print how busy each stage of the pipeline was
+bool print_stats = false;
+
+// decides which files and directories found while walking a directory are skipped
+PathFilter path_filter;
+
+// everything printed while scanning, from any thread, goes to stdout through here
+OutputSink stdout_sink(1);
+
+// with --json everything but the records goes to stderr through here
+OutputSink stderr_sink(2);
+
+// the output of this thread, written out once its buffer is full or a file is done, and while
+// the pipeline scans a file all of it, so the output of files scanned in parallel never interleaves
+thread_local OutputBuffer output_buffer(stdout_sink);
+
+// the messages of this thread with --json
+thread_local OutputBuffer message_buffer(stderr_sink);
+
+// where everything printed while scanning a file goes, but the records of --json
+OutputBuffer & out() {
+    return json_output ? message_buffer : output_buffer;
+}
+
+// where the records of --json go
+OutputBuffer & records() {
+    return output_buffer;
+}
+
+// writes out everything this thread printed so far
+void flushOutput() {
+    output_buffer.flush();
+    if (json_output) message_buffer.flush();
+}
+
+// writes `length` bytes of the file `fd` from `offset` where out() goes, without reading
+// them, false if that is not possible and the caller has to print them itself
+//
+// a scan of the pipeline collects its output, once every file before it was printed it
+// prints the rest of its output itself, until then the caller prints the bytes into the
+// collected output, waiting for the turn would stall the scanner behind a slow file
+bool printFromFile(int fd, std::uint64_t offset, std::uint64_t length) {
+    if (out().is_capturing()) {
+        if (pipeline == nullptr || !pipeline->take_turn()) return false;
+        out().stop_capture();
+    }
+    return out().write_file(fd, offset, length);
+}
+
+// a single search item together with its own replacement
+struct Pattern {
+    std::string search;
+    std::string r;
+    ReplacementTemplate replacement;
+    // the capture group wrapping this pattern in the combined search regex
+    std::size_t group = 0;
+    // the length of the literal text, used to order literal patterns longest first
+    std::size_t length = 0;
+};
 
 struct SearchInfo {
     std::vector<std::string> s;
     std::string search;
-    std::string r;
+    std::vector<Pattern> patterns;
     bool searching = true;
-} search_info;
 
-#include <regex>
+    // the pattern that produced m, m must come from a search with the combined regex
+    template <typename BiDirIt>
+    std::size_t pattern_index(const std::match_results<BiDirIt> & m) const {
+        for (std::size_t i = 0, n = patterns.size(); i < n; i++) {
+            if (m[patterns[i].group].matched) return i;
+        }
+        return 0;
+    }
+
+    template <typename BiDirIt>
+    const ReplacementTemplate & replacement_for(const std::match_results<BiDirIt> & m) const {
+        return patterns[pattern_index(m)].replacement;
+    }
+} search_info;
 
 std::string escape(const char c) {
     if (c == '\n') return "\\n";
@@ -244,7 +369,8 @@ std::string print_escaped(const std::string& s)
     return x;
 }
 
-std::string unescape(const std::string& s, bool unescape_regex, bool unescape_regex_replace)
+// with literal_replace false, '$' keeps its std::regex_replace meaning, allowing '$1' style references
+std::string unescape(const std::string& s, bool unescape_regex, bool unescape_regex_replace, bool literal_replace = true)
 {
     //print_escaped(s);
   std::string x;
@@ -254,6 +380,7 @@ std::string unescape(const std::string& s, bool unescape_regex, bool unescape_re
             const char c = s[i];
             if (slash) {
                 if (c == '\\') x.push_back('\\');
+                else if (c == 'n') x.push_back('\n');
                 else if (c == 't') x.push_back('\t');
                 else if (c == 'r') x.push_back('\r');
                 else if (c == 'v') x.push_back('\v');
@@ -280,7 +407,7 @@ std::string unescape(const std::string& s, bool unescape_regex, bool unescape_re
                 else if (unescape_regex && c == '}') x.append("\\}");
                 else if (unescape_regex && c == '[') x.append("\\[");
                 else if (unescape_regex && c == ']') x.append("\\]");
-                else if (unescape_regex_replace && c == '$') x.append("$$");
+                else if (unescape_regex_replace && literal_replace && c == '$') x.append("$$");
                 else x.push_back(c);
             }
         }
@@ -292,8 +419,6 @@ std::string unescape(const std::string& s, bool unescape_regex, bool unescape_re
   return x;
 }
 
-#include <list>
-
 template <typename BiDirIt>
 struct RegexMatcher {
 
@@ -308,6 +433,10 @@ struct RegexMatcher {
 
         SubMatch(BiDirIt begin, BiDirIt end) : b_first(begin), b_second(end), is_bidir(true) {}
 
+        friend OutputBuffer & operator << (OutputBuffer & o, const SubMatch & m) {
+            return m.is_bidir ? o.write_range(m.b_first, m.b_second) : o.write_range(m.s_first, m.s_second);
+        }
+
         friend std::ostream & operator << (std::ostream & os, const SubMatch & o) {
             if (o.is_bidir) {
                 for (BiDirIt begin = o.b_first; begin != o.b_second; begin++) {
@@ -325,6 +454,25 @@ struct RegexMatcher {
     DarcsPatch::function<void(RegexMatcher<BiDirIt> * instance, const SubMatch & match)> onMatch = [](RegexMatcher<BiDirIt> * instance, const SubMatch & match) {}, onNonMatch = [](RegexMatcher<BiDirIt> * instance, const SubMatch & match) {};
     DarcsPatch::function<void(RegexMatcher<BiDirIt> * instance)> onFinish = [](RegexMatcher<BiDirIt> * instance) {};
 
+    // the search results of the match onMatch is called for, nullptr if it is replayed
+    const std::match_results<BiDirIt> * current_match = nullptr;
+    // the pattern of a replayed match onMatch is called for
+    std::size_t current_pattern = 0;
+    // the offset from the start of the search of the span onMatch or onNonMatch is called for
+    std::uint64_t current_offset = 0;
+
+    // with --binary-results, every match is also added to match_log as found in log_path
+    MatchLog * log = nullptr;
+    const char * log_path = nullptr;
+    std::uint32_t log_file = MatchLog::NO_FILE;
+
+    // adds a match at `offset` from the start of the search to the log, the file is only
+    // added to the log's path table once it has a match
+    void log_match(std::uint64_t offset, std::uint64_t length, std::size_t pattern) {
+        if (log_file == MatchLog::NO_FILE) log_file = log->add_file(log_path);
+        log->add(log_file, offset, length, static_cast<std::uint32_t>(pattern));
+    }
+
     bool search(BiDirIt begin, BiDirIt end, std::regex regex) {
         std::match_results<BiDirIt> current, prev;
         return search_ref(begin, end, current, prev, regex);
@@ -334,8 +482,69 @@ struct RegexMatcher {
         return search_ref(begin, end, current, prev, regex);
     }
 
+    // reports matches that were found elsewhere, for example by several threads, as search would have
+    //
+    // matches must be in order, each with a `position` relative to begin, a `length` and
+    // the `pattern` that found it, or be the results of a search of [begin, end) with the
+    // combined regex, which onMatch then sees as current_match
+    template <typename Matches>
+    bool replay(BiDirIt begin, BiDirIt end, const Matches & matches) {
+        bool match = false;
+        BiDirIt last = begin;
+        std::size_t last_position = 0;
+        for (auto & m : matches) {
+            std::size_t position = position_of(m);
+            std::size_t length = length_of(m);
+            BiDirIt first = std::next(last, position - last_position);
+            BiDirIt second = std::next(first, length);
+            if (!silent && first != last) {
+                current_offset = last_position;
+                onNonMatch(this, {last, first});
+            }
+            if (first != second) {
+                match = true;
+                current_match = results_of(m);
+                current_pattern = pattern_of(m);
+                current_offset = position;
+                if (log != nullptr) log_match(position, length, current_pattern);
+                onMatch(this, {first, second});
+            }
+            last = second;
+            last_position = position + length;
+        }
+        current_match = nullptr;
+        if (!silent && last != end) {
+            current_offset = last_position;
+            onNonMatch(this, {last, end});
+        }
+        onFinish(this);
+        return match;
+    }
+
+    private:
+
+    // what replay needs of a match found elsewhere
+    template <typename Match>
+    static std::size_t position_of(const Match & m) { return m.position; }
+    template <typename Match>
+    static std::size_t length_of(const Match & m) { return m.length; }
+    template <typename Match>
+    static std::size_t pattern_of(const Match & m) { return m.pattern; }
+    template <typename Match>
+    static const std::match_results<BiDirIt> * results_of(const Match &) { return nullptr; }
+
+    // and of the results of a search
+    static std::size_t position_of(const std::match_results<BiDirIt> & m) { return m.position(0); }
+    static std::size_t length_of(const std::match_results<BiDirIt> & m) { return m.length(0); }
+    static std::size_t pattern_of(const std::match_results<BiDirIt> & m) { return search_info.pattern_index(m); }
+    static const std::match_results<BiDirIt> * results_of(const std::match_results<BiDirIt> & m) { return &m; }
+
+    public:
+
     bool search_ref(BiDirIt & begin, BiDirIt & end, std::match_results<BiDirIt> & current, std::match_results<BiDirIt> & prev, std::regex & regex) {
         bool match = false;
+        // how far begin has moved since the start
+        std::uint64_t searched = 0;
         while(true) {
             // std::cout << std::endl << "start search using std::regex_search" << std::endl;
             bool ret = std::regex_search(begin, end, current, regex);
@@ -346,16 +555,21 @@ struct RegexMatcher {
                 if (current.size() != 0) {
                     auto n = current.prefix();
                     if (n.first != n.second) {
+                        current_offset = searched;
                         // std::cout << std::endl << "invoking onNonMatch" << std::endl;
                         onNonMatch(this, {n.first, n.second});
                         // std::cout << "invoked onNonMatch" << std::endl << std::endl;
                     }
                 }
             }
-            for (size_t i = 0; i < current.size(); ++i) {
-                auto & n = current[i];
+            // only the whole match is reported, not the groups of the patterns
+            if (current.size() != 0) {
+                auto & n = current[0];
                 if (n.first != n.second) {
                     match = true;
+                    current_match = &current;
+                    current_offset = searched + current.position();
+                    if (log != nullptr) log_match(current_offset, current.length(), search_info.pattern_index(current));
                     // std::cout << std::endl << "invoking onMatch" << std::endl;
                     onMatch(this, {n.first, n.second});
                     // std::cout << "invoked onMatch" << std::endl << std::endl;
@@ -364,17 +578,20 @@ struct RegexMatcher {
 
             auto next_i = current.position() + current.length();
             begin = std::next(begin, next_i);
+            searched += next_i;
         }
         if (!silent) {
             if (prev.size() != 0) {
                 auto n = prev.suffix();
                 if (n.first != n.second) {
+                    current_offset = searched;
                     // std::cout << std::endl << "invoking onNonMatch" << std::endl;
                     onNonMatch(this, {n.first, n.second});
                     // std::cout << "invoked onNonMatch" << std::endl << std::endl;
                 }
             } else {
                 if (begin != end) {
+                    current_offset = searched;
                     // std::cout << std::endl << "invoking onNonMatch" << std::endl;
                     onNonMatch(this, {begin, end});
                     // std::cout << "invoked onNonMatch" << std::endl << std::endl;
@@ -388,487 +605,1559 @@ struct RegexMatcher {
     }
 };
 
+// calls `piece(data, length)` for the text of [first, last) a piece at a time, straight
+// from memory for pointers and a page at a time for a mapping, any other iterator is
+// copied into `copy` first
+template <typename It, typename Piece>
+void forEachPiece(It first, It last, std::string & copy, Piece && piece) {
+    if constexpr (std::is_pointer<It>::value) {
+        if (first != last) piece(first, last - first);
+    } else if constexpr (std::is_same<It, MMapIterator>::value) {
+        std::size_t remaining = last.get_index() - first.get_index();
+        while (remaining != 0) {
+            std::size_t length;
+            const char * data = first.page_data(length);
+            if (length > remaining) length = remaining;
+            piece(data, length);
+            first += length;
+            remaining -= length;
+        }
+    } else {
+        // the copy is only ever so large
+        const std::size_t COPY_SIZE = 64*1024;
+        while (first != last) {
+            copy.clear();
+            for (; first != last && copy.size() < COPY_SIZE; first++) {
+                copy.push_back(*first);
+            }
+            piece(copy.data(), copy.size());
+        }
+    }
+}
+
+// reports a search line by line for -n, onPrintLine is called with the number of a line,
+// counted from 1, then its pieces are passed to onMatch and onNonMatch in order
+//
+// only the lines with a match are reported, every line with --print-all, each with its
+// newline, the last line gets one if it has none
+//
+// the spans are split into lines with memchr, the whole lines of a non match that are
+// not printed are only counted, and only the start of a line that continues in the
+// next span is copied
 template <typename BiDirIt>
 struct RegexMatcherWithLineInfo : public RegexMatcher<BiDirIt> {
 
     using SubMatch = typename RegexMatcher<BiDirIt>::SubMatch;
 
-    int64_t line = 0;
+    // a piece of a line, only valid during the call
+    using Piece = DarcsPatch::function<void(RegexMatcher<BiDirIt> * instance, const char * data, std::size_t length)>;
 
-    DarcsPatch::function<void(RegexMatcher<BiDirIt> * instance, const SubMatch & match)> onMatch = [](RegexMatcher<BiDirIt> * instance, const SubMatch & match) {}, onNonMatch = [](RegexMatcher<BiDirIt> * instance, const SubMatch & match) {};
+    Piece onMatch = [](RegexMatcher<BiDirIt> * instance, const char * data, std::size_t length) {}, onNonMatch = [](RegexMatcher<BiDirIt> * instance, const char * data, std::size_t length) {};
     DarcsPatch::function<void(RegexMatcher<BiDirIt> * instance, uint64_t line)> onPrintLine = [](RegexMatcher<BiDirIt> * instance, uint64_t line) {};
 
     private:
 
-    std::list<std::string> accumulation;
-    bool was_on_match = false;
-    bool needs_reset = true;
+    // the number of the current line
+    uint64_t line = 1;
+    // the start of the current line and its pieces, each with its length and whether it is a match
+    std::string pending;
+    std::vector<std::pair<std::size_t, bool>> pieces;
     bool line_has_match = false;
+    // the text of a span that is not in memory as it is
+    std::string copy;
+
+    // adds to the start of the current line, joined with the last piece if it is of the same kind
+    void keep(const char * data, std::size_t length, bool is_match) {
+        pending.append(data, length);
+        if (!pieces.empty() && pieces.back().second == is_match) {
+            pieces.back().first += length;
+        } else {
+            pieces.emplace_back(length, is_match);
+        }
+        if (is_match) line_has_match = true;
+    }
 
-    using MATCHES = std::vector<std::pair<DarcsPatch::function<void(RegexMatcher<BiDirIt> * instance, const SubMatch & match)>, SubMatch>>;
-
-    MATCHES matches;
-
-    void reset(RegexMatcher<BiDirIt> * instance, DarcsPatch::function<void(RegexMatcher<BiDirIt> * instance, const SubMatch & match)> & match_func) {
-        if (print_lines && (print_non_matches || line_has_match)) {
-            if (matches.size() != 0) {
-                onPrintLine(instance, line);
-                for (auto & p : matches) {
-                    p.first(instance, p.second);
-                }
-                if (accumulation.back().size() != 0) {
-                    match_func(instance, {accumulation.back().begin(), accumulation.back().end()});
-                }
+    // ends the current line with a piece that holds its newline
+    void end_line(const char * data, std::size_t length, bool is_match) {
+        if (print_non_matches || line_has_match || is_match) {
+            onPrintLine(this, line);
+            if (pieces.empty()) {
+                (is_match ? onMatch : onNonMatch)(this, data, length);
             } else {
-                if (accumulation.back().size() != 0) {
-                    onPrintLine(instance, line);
-                    match_func(instance, {accumulation.back().begin(), accumulation.back().end()});
+                keep(data, length, is_match);
+                const char * piece = pending.data();
+                for (auto & p : pieces) {
+                    (p.second ? onMatch : onNonMatch)(this, piece, p.first);
+                    piece += p.first;
                 }
             }
         }
         line++;
-        if (!print_lines && (print_non_matches || line_has_match)) {
-            if (accumulation.back().size() != 0) {
-                onPrintLine(instance, line);
-                match_func(instance, {accumulation.back().begin(), accumulation.back().end()});
-            }
-        }
-        accumulation = std::move(std::list<std::string>());
-        accumulation.emplace_back(std::string());
-        matches = std::move(MATCHES());
+        pending.clear();
+        pieces.clear();
+        line_has_match = false;
     }
 
-    void finish(RegexMatcher<BiDirIt> * instance, DarcsPatch::function<void(RegexMatcher<BiDirIt> * instance, const SubMatch & match)> & match_func, DarcsPatch::function<void(RegexMatcher<BiDirIt> * instance, const SubMatch & match)> & match_func_opposite, bool from_on_match) {
-        if (was_on_match != from_on_match && accumulation.back().size() != 0) {
-            if (print_lines) {
-                matches.push_back({match_func_opposite, {accumulation.back().begin(), accumulation.back().end()}});
-            } else {
-                match_func_opposite(instance, {accumulation.back().begin(), accumulation.back().end()});
+    void add(const char * data, std::size_t length, bool is_match) {
+        const char * end = data + length;
+        while (data != end) {
+            auto newline = static_cast<const char *>(memchr(data, '\n', end - data));
+            if (newline == nullptr) {
+                keep(data, end - data, is_match);
+                return;
+            }
+            end_line(data, newline + 1 - data, is_match);
+            data = newline + 1;
+            if (!is_match && !print_non_matches) {
+                std::size_t lines = count_newlines(data, end - data);
+                if (lines != 0) {
+                    line += lines;
+                    const char * last_line = end;
+                    while (last_line[-1] != '\n') last_line--;
+                    data = last_line;
+                }
             }
-            accumulation.emplace_back(std::string());
-            was_on_match = from_on_match;
-        }
-        if (needs_reset) {
-            reset(instance, match_func);
-            needs_reset = false;
-            line_has_match = false;
-            std::cout.flush();
-        }
-    }
-    void process(RegexMatcher<BiDirIt> * instance, DarcsPatch::function<void(RegexMatcher<BiDirIt> * instance, const SubMatch & match)> & match_func, DarcsPatch::function<void(RegexMatcher<BiDirIt> * instance, const SubMatch & match)> & match_func_opposite, bool from_on_match, const char c) {
-        // std::cout << "process: char = " << escape(c) << std::endl;
-        finish(this, match_func, match_func_opposite, from_on_match);
-        accumulation.back().push_back(c);
-        if (c == '\n') {
-            needs_reset = true;
         }
-        if (from_on_match) line_has_match = true;
     }
-    void flush(RegexMatcher<BiDirIt> * instance, const SubMatch & match, bool from_on_match) {
-        auto match_func = from_on_match ? onMatch : onNonMatch;
-        auto match_func_opposite = !from_on_match ? onMatch : onNonMatch;
+
+    void add(const SubMatch & match, bool is_match) {
+        auto piece = [&](const char * data, std::size_t length) {
+            add(data, length, is_match);
+        };
         if (match.is_bidir) {
-            for (BiDirIt begin = match.b_first; begin != match.b_second; begin++) {
-                process(instance, match_func, match_func_opposite, from_on_match, *begin);
-            }
+            forEachPiece(match.b_first, match.b_second, copy, piece);
         } else {
-            for (auto begin = match.s_first; begin != match.s_second; begin++) {
-                process(instance, match_func, match_func_opposite, from_on_match, *begin);
-            }
+            forEachPiece(match.s_first, match.s_second, copy, piece);
         }
-        was_on_match = from_on_match;
     }
 
     public:
 
     RegexMatcherWithLineInfo() {
         RegexMatcher<BiDirIt>::onMatch = [](RegexMatcher<BiDirIt> * instance, const SubMatch & match) {
-            static_cast<RegexMatcherWithLineInfo<BiDirIt>*>(instance)->flush(instance, match, true);
+            static_cast<RegexMatcherWithLineInfo<BiDirIt>*>(instance)->add(match, true);
         };
         RegexMatcher<BiDirIt>::onNonMatch = [](RegexMatcher<BiDirIt> * instance, const SubMatch & match) {
-            static_cast<RegexMatcherWithLineInfo<BiDirIt>*>(instance)->flush(instance, match, false);
+            static_cast<RegexMatcherWithLineInfo<BiDirIt>*>(instance)->add(match, false);
         };
         RegexMatcher<BiDirIt>::onFinish = [](RegexMatcher<BiDirIt> * instance) {
-            if (static_cast<RegexMatcherWithLineInfo<BiDirIt>*>(instance)->needs_reset) {
-                static_cast<RegexMatcherWithLineInfo<BiDirIt>*>(instance)->finish(instance, static_cast<RegexMatcherWithLineInfo<BiDirIt>*>(instance)->onNonMatch, static_cast<RegexMatcherWithLineInfo<BiDirIt>*>(instance)->onMatch, false);
-            } else {
-                static_cast<RegexMatcherWithLineInfo<BiDirIt>*>(instance)->needs_reset = true;
-                static_cast<RegexMatcherWithLineInfo<BiDirIt>*>(instance)->accumulation.back().push_back('\n');
-                static_cast<RegexMatcherWithLineInfo<BiDirIt>*>(instance)->finish(instance, static_cast<RegexMatcherWithLineInfo<BiDirIt>*>(instance)->onNonMatch, static_cast<RegexMatcherWithLineInfo<BiDirIt>*>(instance)->onMatch, false);
-            }
+            auto self = static_cast<RegexMatcherWithLineInfo<BiDirIt>*>(instance);
+            // the newline of the last line goes into its last piece
+            if (!self->pieces.empty()) self->end_line("\n", 1, self->pieces.back().second);
         };
-        accumulation.emplace_back(std::string());
     }
 };
 
+// the length of a span without walking it, 0 if that is not possible
+inline std::uint64_t spanLength(const char * first, const char * second) {
+    return second - first;
+}
+
+inline std::uint64_t spanLength(const MMapIterator & first, const MMapIterator & second) {
+    return second.get_index() - first.get_index();
+}
+
+template <typename BiDirIt>
+std::uint64_t spanLength(const BiDirIt &, const BiDirIt &) {
+    return 0;
+}
+
+// with --print-all, a non match of at least OutputWriter::copy_threshold bytes is sent
+// from the searched file straight to stdout with printFromFile, when the search has a
+// file to read it from
 template <typename BiDirIt>
 struct RegexSearcher : public RegexMatcher<BiDirIt> {
     using BASE = RegexMatcher<BiDirIt>;
     using SubMatch = typename BASE::SubMatch;
-    RegexSearcher() {
+    // the file that is searched, nullptr if there is none
+    const char * source_path;
+    // opened on the first large non match, -1 until then or if it can not be opened
+    int source_fd = -1;
+    bool source_failed = false;
+
+    RegexSearcher(const char * source_path = nullptr) : source_path(source_path) {
         BASE::onMatch = [](RegexMatcher<BiDirIt> * instance, const SubMatch & match) {
             if (!silent) {
-                std::cout << "match: '" << match << "'" << std::endl;
+                out() << "match: '" << match << "'" << '\n';
             }
         };
         BASE::onNonMatch = [](RegexMatcher<BiDirIt> * instance, const SubMatch & match) {
             if (!silent) {
                 if (print_non_matches) {
-                    std::cout << "non match: '" << match << "'" << std::endl;
+                    auto self = static_cast<RegexSearcher<BiDirIt>*>(instance);
+                    out() << "non match: '";
+                    std::uint64_t length = match.is_bidir ? spanLength(match.b_first, match.b_second) : 0;
+                    if (length < OutputWriter::copy_threshold || !self->print_from_source(length)) {
+                        out() << match;
+                    }
+                    out() << "'" << '\n';
                 }
             }
         };
     }
+
+    ~RegexSearcher() {
+        if (source_fd != -1) close(source_fd);
+    }
+
+    RegexSearcher(const RegexSearcher &) = delete;
+    RegexSearcher & operator=(const RegexSearcher &) = delete;
+
+    // prints the current non match from the searched file
+    bool print_from_source(std::uint64_t length) {
+        if (source_fd == -1) {
+            if (source_path == nullptr || source_failed) return false;
+            source_fd = open(source_path, O_RDONLY);
+            if (source_fd == -1) {
+                source_failed = true;
+                return false;
+            }
+        }
+        if (printFromFile(source_fd, BASE::current_offset, length)) return true;
+        // stdout is a terminal, while capturing the turn of this scan may still come
+        if (!out().is_capturing()) source_failed = true;
+        return false;
+    }
 };
 
+// the colors of -n
+const char * const COLOR_RESET = "\033[00m";
+const char * const MATCH_COLOR = "\033[38;2;255;0;0m";
+const char * const FILE_COLOR = "\033[38;2;128;0;255m";
+const char * const COLON_COLOR = "\033[38;2;255;128;255m";
+const char * const LINE_NUMBER_COLOR = "\033[38;2;0;128;255m";
+
 template <typename BiDirIt>
 struct RegexSearcherWithLineInfo : public RegexMatcherWithLineInfo<BiDirIt> {
     using BASE = RegexMatcherWithLineInfo<BiDirIt>;
     using SubMatch = typename BASE::SubMatch;
     const char * current_path;
+    // everything printed before the number of each line, built once
+    std::string line_prefix;
     RegexSearcherWithLineInfo(const char * current_path) : current_path(current_path) {
-        BASE::onMatch = [](RegexMatcher<BiDirIt> * instance, const SubMatch & match) {
+        line_prefix = std::string(FILE_COLOR) + current_path + COLON_COLOR + ":" + LINE_NUMBER_COLOR;
+        BASE::onMatch = [](RegexMatcher<BiDirIt> * instance, const char * data, std::size_t length) {
             if (!silent) {
-                std::cout << "\033[38;2;255;0;0m" << match << "\033[00m";
+                out() << MATCH_COLOR;
+                out().write(data, length) << COLOR_RESET;
             }
         };
-        BASE::onNonMatch = [](RegexMatcher<BiDirIt> * instance, const SubMatch & match) {
+        BASE::onNonMatch = [](RegexMatcher<BiDirIt> * instance, const char * data, std::size_t length) {
             if (!silent) {
-                std::cout << match;
+                out().write(data, length);
             }
         };
         BASE::onPrintLine = [](RegexMatcher<BiDirIt> * instance, uint64_t line) {
             if (!silent) {
-                const char * color_reset = "\033[00m";
-                const char * file_color = "\033[38;2;128;0;255m";
-                const char * colon_color = "\033[38;2;255;128;255m";
-                const char * line_number_color = "\033[38;2;0;128;255m";
-                std::cout << file_color << static_cast<RegexSearcherWithLineInfo<BiDirIt>*>(instance)->current_path << colon_color << ":" << line_number_color << std::to_string(line) << color_reset << ":";
+                char number[24];
+                auto end = std::to_chars(number, number + sizeof(number), line).ptr;
+                out() << static_cast<RegexSearcherWithLineInfo<BiDirIt>*>(instance)->line_prefix;
+                out().write(number, end - number) << COLOR_RESET << ':';
             }
         };
     }
 };
 
-bool invokeMMAP(const char * path) {
-    auto regex_flags = std::regex::ECMAScript | std::regex::optimize;
-    if (ignore_case) regex_flags |= std::regex::icase;
-
-    if (search_info.searching) {
-
-        if (use_mmap) {
-            MMapHelper map(path, 'r');
+// prints every match as a JSON record for --json, with its byte offset, its line and column
+// counted from 1, the index of the pattern that found it and its replacement when replacing
+template <typename BiDirIt>
+struct RegexSearcherJson : public RegexMatcher<BiDirIt> {
+    using BASE = RegexMatcher<BiDirIt>;
+    using SubMatch = typename BASE::SubMatch;
+    const char * current_path;
+    std::size_t path_length;
+    std::uint64_t offset = 0;
+    std::uint64_t line = 1;
+    std::uint64_t line_start = 0;
+
+    // the text of a span that is not in memory as it is
+    std::string span_copy;
+
+    // counts the lines in [data, data + length), which starts at offset
+    void advance(const char * data, std::size_t length) {
+        std::size_t lines = count_newlines(data, length);
+        if (lines != 0) {
+            line += lines;
+            const char * last_line = data + length;
+            while (last_line[-1] != '\n') last_line--;
+            line_start = offset + (last_line - data);
+        }
+        offset += length;
+    }
 
-            auto map_len = map.length();
+    void advance(const SubMatch & match) {
+        auto piece = [&](const char * data, std::size_t length) {
+            advance(data, length);
+        };
+        if (match.is_bidir) {
+            forEachPiece(match.b_first, match.b_second, span_copy, piece);
+        } else {
+            forEachPiece(match.s_first, match.s_second, span_copy, piece);
+        }
+    }
 
-            if (map.is_open() && map_len == 0) {
-                std::cout << "skipping zero length file: " << path << std::endl;
-                return false;
+    void print(const SubMatch & match) {
+        // the text of a match that is not in contiguous memory, reused for every match
+        thread_local std::string copy;
+        const char * text;
+        std::size_t length;
+        if constexpr (std::is_pointer<BiDirIt>::value) {
+            text = match.b_first;
+            length = match.b_second - match.b_first;
+        } else {
+            copy.assign(match.b_first, match.b_second);
+            text = copy.data();
+            length = copy.size();
+        }
+        std::size_t pattern = BASE::current_match != nullptr ? search_info.pattern_index(*BASE::current_match) : BASE::current_pattern;
+
+        JsonRecord record(records());
+        record.string("path", current_path, path_length)
+            .number("offset", offset)
+            .number("length", length)
+            .number("line", line)
+            .number("column", offset - line_start + 1)
+            .number("pattern", pattern);
+        if (!search_info.searching) {
+            record.begin_string("replacement");
+            auto & replacement = search_info.patterns[pattern].replacement;
+            if (BASE::current_match != nullptr) {
+                replacement.apply(*BASE::current_match, [&](const char * data, std::size_t length, bool stable) {
+                    record.string_part(data, length);
+                });
+            } else {
+                // only literal replacements are replayed
+                record.string_part(replacement.literal_text().data(), replacement.literal_text().size());
             }
+            record.end_string();
+        }
+        record.string("match", text, length).end();
+    }
 
-            if (!map.is_open()) {
-                std::cout << "failed to open file: " << path << std::endl;
-                return false;
-            }
+    RegexSearcherJson(const char * current_path) : current_path(current_path), path_length(strlen(current_path)) {
+        BASE::onMatch = [](RegexMatcher<BiDirIt> * instance, const SubMatch & match) {
+            auto self = static_cast<RegexSearcherJson<BiDirIt>*>(instance);
+            self->print(match);
+            self->advance(match);
+        };
+        BASE::onNonMatch = [](RegexMatcher<BiDirIt> * instance, const SubMatch & match) {
+            static_cast<RegexSearcherJson<BiDirIt>*>(instance)->advance(match);
+        };
+    }
+};
 
-            MMapIterator begin(map, 0);
-            MMapIterator end(map, map_len);
+// runs `search` with the matcher that prints matches the way the options ask for, returns its result
+//
+// with --silent nothing is printed and the non matches are not even reported to the matcher
+//
+// with --binary-results the matcher also adds every match to match_log
+//
+// `seekable` tells whether the search reads path itself from its start, so that
+// --print-all can print large non matches straight from it
+//
+// the matches are printed and logged as found in `name`, path unless given
+template <typename BiDirIt, typename Search>
+bool withMatcher(const char * path, Search && search, bool seekable = true, const char * name = nullptr) {
+    if (name == nullptr) name = path;
+    auto run = [&](RegexMatcher<BiDirIt> & matcher) {
+        matcher.log = match_log;
+        matcher.log_path = name;
+        return search(matcher);
+    };
+    if (json_output && !silent) {
+        RegexSearcherJson<BiDirIt> matcher(name);
+        return run(matcher);
+    }
+    if (print_lines && !silent) {
+        RegexSearcherWithLineInfo<BiDirIt> matcher(name);
+        return run(matcher);
+    }
+    RegexSearcher<BiDirIt> matcher(seekable ? path : nullptr);
+    return run(matcher);
+}
 
-            std::regex e(search_info.search, regex_flags);
+// writes the replaced contents of path through `write`, which is given the fd to write to
+//
+// a dry run writes into a temporary file that is left behind for inspection,
+// otherwise the contents are written into a temporary file in the same directory
+// as path which is then atomically renamed over it, so path is never left half written
+template <typename Writer>
+bool replaceFile(const char * path, Writer && write) {
+    if (dry_run) {
+        out() << "replacing (dry run) ..." << '\n';
 
-            std::cout << "searching file '" << path << "' with a length of " << std::to_string(map_len) << " bytes ..." << std::endl;
-            std::cout << "using mmap api" << std::endl;
-            // for (auto begin_ = begin; begin_ != end; begin_++) {
-            //     auto c = *begin_;
-            // }
-            // return true;
-            if (print_lines && !silent) {
-                return RegexSearcherWithLineInfo<MMapIterator>(path).search(begin, end, e);
-            } else {
-                return RegexSearcher<MMapIterator>().search(begin, end, e);
-            }
-        } else {
-            std::regex e(search_info.search, regex_flags);
+        TempFile tmp_file("FindReplace__replace_", true);
 
-            std::cout << "searching file '" << path << "' ..." << std::endl;
-            std::cout << "using ifstream api" << std::endl;
-            auto stream = std::ifstream(path, std::ios::binary | std::ios::in);
-            // for (std::string line; std::getline(stream, line); ) {
+        int fd = open(tmp_file.get_path().c_str(), O_WRONLY | O_TRUNC);
+        if (fd != -1) {
+            write(fd);
+            close(fd);
+        }
 
-            // }
-            // return true;
-            auto begin = ifstream_iterator(stream, 0);
-            auto end = ifstream_iterator(stream);
-            // for (auto begin_ = begin; begin_ != end; begin_++) {
-            //     auto c = *begin_;
-            // }
-            // return true;
-            if (print_lines && !silent) {
-                return RegexSearcherWithLineInfo<ifstream_iterator>(path).search(begin, end, e);
-            } else {
-                return RegexSearcher<ifstream_iterator>().search(begin, end, e);
-            }
+        // for sake of readability
+        if (!no_detach) {
+            tmp_file.detach();
         }
-    } else {
+        return false;
+    }
 
-        TempFile tmp_file("FindReplace__replace_", true);
+    out() << "replacing ..." << '\n';
 
-        std::size_t old_len;
+    AtomicFile file(path);
 
-        if (use_mmap) {
-            MMapHelper map(path, 'r');
+    if (!file.is_open()) {
+        out() << "failed to create temporary file for: " << path << '\n';
+        return false;
+    }
 
-            old_len = map.length();
+    if (!write(file.get_fd())) {
+        out() << "failed to write replacement of file: " << path << '\n';
+        return false;
+    }
 
-            if (map.is_open() && old_len == 0) {
-                std::cout << "skipping zero length file: " << path << std::endl;
-                return false;
-            }
+    if (!file.commit()) {
+        out() << "failed to replace file: " << path << '\n';
+        return false;
+    }
+    return true;
+}
 
-            if (!map.is_open()) {
-                std::cout << "failed to open file: " << path << std::endl;
-                return false;
-            }
+// std::regex_replace for the iterators that cannot be written as slices of a mapping,
+// using the compiled replacement template instead of re-parsing the format string per match
+template <typename BiDirIt>
+void replaceStream(BiDirIt begin, BiDirIt end, std::regex & e, std::ostream & o) {
+    auto out_iter = std::ostream_iterator<char>(o);
+    BiDirIt last = begin;
+    for (std::regex_iterator<BiDirIt> it(begin, end, e), it_end; it != it_end; ++it) {
+        auto & m = *it;
+        out_iter = std::copy(last, m[0].first, out_iter);
+        search_info.replacement_for(m).apply(m, [&](const char * data, std::size_t length, bool) {
+            o.write(data, length);
+        });
+        last = m[0].second;
+    }
+    std::copy(last, end, out_iter);
+}
 
-            MMapIterator begin(map, 0);
-            MMapIterator end(map, old_len);
+// runs `write` against a buffered std::ostream on fd
+template <typename Writer>
+bool writeStream(int fd, Writer && write) {
+    FdStreamBuffer buffer(fd);
+    std::ostream o(&buffer);
+    write(o);
+    o.flush();
+    return static_cast<bool>(o);
+}
 
-            std::regex e(search_info.search, regex_flags);
+// the matches of a regex in [begin, end) as a range, each one found as the range is iterated
+template <typename BiDirIt>
+struct RegexMatches {
+    std::regex_iterator<BiDirIt> first;
 
-            std::cout << "searching file '" << path << "' with a length of " << std::to_string(map.length()) << " bytes ..." << std::endl;
-            std::cout << "using mmap api" << std::endl;
-            if (print_lines && !silent) {
-                if (!RegexSearcherWithLineInfo<MMapIterator>(path).search(begin, end, e)) {
-                    return false;
-                }
-            } else {
-                if (!RegexSearcher<MMapIterator>().search(begin, end, e)) {
-                    return false;
-                }
-            }
+    std::regex_iterator<BiDirIt> begin() const { return first; }
+    std::regex_iterator<BiDirIt> end() const { return {}; }
+};
 
-            if (dry_run) {
-                std::cout << "replacing (dry run) ..." << std::endl;
+// replaces `matches`, the matches in [data, data + length) in order, and writes the result to out_fd
+//
+// only the replacements pass through user space, the unchanged text between
+// matches is handed to the OutputWriter as slices of the source
+template <typename Matches>
+bool replaceContiguous(const char * data, std::size_t length, int src_fd, int out_fd, const Matches & matches) {
+    OutputWriter writer(out_fd, src_fd, data);
+    std::size_t last = 0;
+    for (auto & m : matches) {
+        std::size_t position = m[0].first - data;
+        writer.copy(last, position - last);
+        search_info.replacement_for(m).apply(m, [&](const char * data, std::size_t length, bool stable) {
+            // stable data is either the template itself or part of the mapping, both outlive the writer
+            if (stable) {
+                writer.write_stable(data, length);
             } else {
-                std::cout << "replacing ..." << std::endl;
+                writer.write(data, length);
             }
-            std::ofstream o (tmp_file.get_path(), std::ios::binary | std::ios::out);
+        });
+        last = position + m.length(0);
+    }
+    writer.copy(last, length - last);
+    return writer.flush();
+}
 
-            auto out_iter = std::ostream_iterator<char>(o);
+// a match that can be overwritten without moving any other byte of the file
+struct InPlacePatch {
+    std::size_t position;
+    std::string replacement;
+};
 
-            std::regex_replace(out_iter, begin, end, e, search_info.r);
+// collects the replacement of every one of `matches`, the matches from begin on in order,
+// returns false as soon as a replacement would change the length of the text it replaces
+//
+// a replacement that equals the text it replaces is left out, writing it would only dirty its page
+template <typename BiDirIt, typename Matches>
+bool collectInPlacePatches(BiDirIt begin, const Matches & matches, std::vector<InPlacePatch> & patches) {
+    // positions are tracked incrementally, std::distance from begin would be quadratic for bidirectional iterators
+    std::size_t position = 0;
+    BiDirIt last = begin;
+    for (auto & m : matches) {
+        std::string replacement = search_info.replacement_for(m).format(m);
+        if (replacement.size() != static_cast<std::size_t>(m.length(0))) {
+            return false;
+        }
+        position += std::distance(last, m[0].first);
+        last = m[0].first;
+        if (std::equal(replacement.begin(), replacement.end(), m[0].first)) continue;
+        patches.push_back({position, std::move(replacement)});
+    }
+    return true;
+}
 
-            o.flush();
-            o.close();
+// writes the mapped bytes at data back to their file before returning
+bool syncMapping(char * data, std::size_t length) {
+#ifdef _WIN32
+    return FlushViewOfFile(data, length) != 0;
+#else
+    // msync wants the start of a page, a mapping only starts on one if it starts at offset 0
+    std::uintptr_t page = sysconf(_SC_PAGESIZE);
+    std::uintptr_t start = reinterpret_cast<std::uintptr_t>(data) & ~(page - 1);
+    std::uintptr_t end = reinterpret_cast<std::uintptr_t>(data) + length;
+    while (msync(reinterpret_cast<void *>(start), end - start, MS_SYNC) == -1) {
+        if (errno != EINTR) return false;
+    }
+    return true;
+#endif
+}
 
-            // end of mmap scope
-        } else {
-            std::regex e(search_info.search, regex_flags);
+// writes everything written to path, also through a mapping that is gone already, to the disk
+bool syncFile(const char * path) {
+#ifdef _WIN32
+    int fd = _open(path, _O_RDWR | _O_BINARY);
+    if (fd == -1) return false;
+    bool synced = _commit(fd) == 0;
+    _close(fd);
+#else
+    int fd = open(path, O_RDWR);
+    if (fd == -1) return false;
+    bool synced;
+    while (!(synced = fsync(fd) == 0) && errno == EINTR) {}
+    close(fd);
+#endif
+    return synced;
+}
 
-            std::cout << "searching file '" << path << "' ..." << std::endl;
-            std::cout << "using ifstream api" << std::endl;
-            auto stream = std::ifstream(path, std::ios::binary | std::ios::in);
+// writes each patch directly into a writable mapping of path, no temporary file is involved
+//
+// this relies on MMapHelper(path, 'w') mapping the file shared and writable (MAP_SHARED, or
+// a view of a file mapping on windows), so every byte written into the mapping is a byte
+// written into the file. The patched bytes are synced before returning, and a match that
+// already equals its replacement was never made a patch
+//
+// unlike replaceFile this is not atomic, a crash while patching leaves some matches replaced
+bool patchInPlace(const char * path, const std::vector<InPlacePatch> & patches) {
+    if (patches.empty()) {
+        out() << "every match already equals its replacement, nothing to patch" << '\n';
+        return false;
+    }
 
-            ifstream_iterator::State stream_init;
-            stream_init.save(&stream);
+    if (dry_run) {
+        out() << "patching " << std::to_string(patches.size()) << " matches in place (dry run) ..." << '\n';
+        return false;
+    }
 
-            auto begin = ifstream_iterator(stream, 0);
-            auto end = ifstream_iterator(stream);
+    out() << "patching " << std::to_string(patches.size()) << " matches in place ..." << '\n';
 
-            if (print_lines && !silent) {
-                if (!RegexSearcherWithLineInfo<ifstream_iterator>(path).search(begin, end, e)) {
-                    return false;
-                }
-            } else {
-                if (!RegexSearcher<ifstream_iterator>().search(begin, end, e)) {
-                    return false;
+    MMapHelper map(path, 'w');
+
+    if (!map.is_open()) {
+        out() << "failed to open file for writing: " << path << '\n';
+        return false;
+    }
+
+    bool synced;
+    auto whole = map.obtain_map(0, map.length());
+    if (whole.get() != nullptr) {
+        char * data = static_cast<char *>(whole->get());
+        for (auto & patch : patches) {
+            memcpy(data + patch.position, patch.replacement.data(), patch.replacement.size());
+        }
+        synced = syncMapping(data, map.length());
+    } else {
+        {
+            // a single iterator is advanced through the file so pages are only remapped when a patch crosses into a new one
+            MMapIterator it(map, 0);
+            std::size_t position = 0;
+            for (auto & patch : patches) {
+                it += patch.position - position;
+                position = patch.position;
+                for (char c : patch.replacement) {
+                    *it = c;
+                    it++;
+                    position++;
                 }
             }
+        }
+        // the pages of the iterator are unmapped, their changes are still in the file's cache
+        synced = syncFile(path);
+    }
+    if (!synced) {
+        out() << "failed to sync patched file: " << path << '\n';
+        return false;
+    }
+    return true;
+}
 
-            if (dry_run) {
-                std::cout << "replacing (dry run) ..." << std::endl;
-            } else {
-                std::cout << "replacing ..." << std::endl;
-            }
+// files from this size on are replaced by replaceSegmented
+std::size_t parallel_threshold = 64*1024*1024;
 
-            std::ofstream o (tmp_file.get_path(), std::ios::binary | std::ios::out);
+// the smallest segment replaceSegmented splits a file into
+std::size_t segment_size = 8*1024*1024;
 
-            auto out_iter = std::ostream_iterator<char>(o);
+// the longest text a --regex pattern can match as given by --max-match-length, 0 if unknown
+std::size_t max_match_length = 0;
 
-            stream_init.restore(&stream);
-            auto begin_ = ifstream_iterator(stream, 0);
-            auto end_ = ifstream_iterator(stream);
-            std::regex_replace(out_iter, begin_, end_, e, search_info.r);
+// --max-match-length line, no --regex pattern matches across a newline
+bool match_within_lines = false;
 
-            o.flush();
-            o.close();
+// the longest text any pattern can match, 0 if a --regex pattern makes it unknown
+std::size_t maxMatchLength() {
+    if (use_regex) return max_match_length;
+    std::size_t length = 0;
+    for (auto & p : search_info.patterns) {
+        length = std::max(length, p.length);
+    }
+    return length;
+}
 
-            // end of mmap scope
-        }
+// true if a file can be searched in segments, SegmentedSearch must know how far a match can
+// reach past the end of a segment, or that segments can end at a newline instead
+bool canSegment() {
+    return maxMatchLength() != 0 || (use_regex && match_within_lines);
+}
 
-        if (dry_run) {
-            // for sake of readability
-            if (no_detach) {
-                return false;
-            } else {
-                tmp_file.detach();
-                return false;
-            }
-        }
+SegmentedSearch makeSegmentedSearch(const char * data, std::size_t length, std::regex & e) {
+    bool lines = use_regex && match_within_lines;
+    return SegmentedSearch(data, length, e, lines ? 0 : maxMatchLength(), lines, [](const std::cmatch & m) {
+        return search_info.pattern_index(m);
+    });
+}
 
-        MMapHelper map2(tmp_file.get_path().c_str(), 'r');
+// a large file is split into up to this many segments per job, so the jobs still finish together
+// when some segments take longer than others or some jobs only join in once their own file is done
+const std::size_t SEGMENTS_PER_JOB = 4;
 
-        auto new_len = map2.length();
+// the number of segments to split a file of the given length into, 1 if it should not be split
+std::size_t segmentCount(std::size_t length) {
+    if (length < parallel_threshold || !canSegment() || jobs == 1) return 1;
+    return std::max<std::size_t>(1, std::min<std::size_t>(jobs * SEGMENTS_PER_JOB, length / segment_size));
+}
 
-        if (map2.is_open() && new_len == 0) {
-            std::cout << "skipping zero length file: " << tmp_file.get_path() << std::endl;
-            return false;
-        }
-
-        if (!map2.is_open()) {
-            std::cout << "failed to open file: " << tmp_file.get_path() << std::endl;
-            return false;
+// runs task(0) .. task(count-1) in parallel, within a scan of the pipeline on the scanners that
+// are waiting for a file, anywhere else on up to jobs threads
+void parallelFor(std::size_t count, const std::function<void(std::size_t)> & task) {
+    if (pipeline != nullptr && ScanPipeline::on_scanner()) {
+        pipeline->parallel_for(count, task);
+        return;
+    }
+    std::atomic<std::size_t> next {0};
+    auto run = [&] {
+        for (std::size_t i; (i = next++) < count; ) {
+            task(i);
         }
+    };
+    std::vector<std::thread> threads;
+    for (std::size_t i = 1; i < std::min<std::size_t>(jobs, count); i++) {
+        threads.emplace_back(run);
+    }
+    run();
+    for (auto & t : threads) t.join();
+}
 
-        MMapIterator begin_in(map2, 0);
-        MMapIterator end_in(map2, new_len);
+// searches the segments of a large mapped file in parallel, the matches are
+// then printed in file order exactly as a sequential search would print them
+bool searchSegmented(const char * path, const char * name, const char * data, std::size_t length, std::regex & e, std::size_t segments) {
+    SegmentedSearch search = makeSegmentedSearch(data, length, e);
+
+    out() << "searching file '" << name << "' with a length of " << std::to_string(length) << " bytes in " << std::to_string(segments) << " segments ..." << '\n';
+    out() << "using mmap api" << '\n';
+
+    search.run(segments, parallelFor);
+
+    return withMatcher<const char *>(path, [&](auto & matcher) {
+        return matcher.replay(data, data + length, search.get_matches());
+    }, true, name);
+}
+
+// replaces all matches in a large mapped file, segment by segment in parallel
+//
+// the segments are searched by SegmentedSearch, which also makes sure no match crosses a
+// segment boundary, then each segment's output length is known up front and every segment
+// is written at its final offset of the output with its own OutputWriter
+//
+// only used when canSegment() and no replacement refers to the match, so every replacement has a fixed length
+bool replaceSegmented(const char * path, const char * data, std::size_t length, int src_fd, std::regex & e, std::size_t segments) {
+    SegmentedSearch search = makeSegmentedSearch(data, length, e);
+
+    out() << "searching file '" << path << "' with a length of " << std::to_string(length) << " bytes in " << std::to_string(segments) << " segments ..." << '\n';
+    out() << "using mmap api" << '\n';
+
+    search.run(segments, parallelFor);
+
+    auto & matches = search.get_matches();
+
+    withMatcher<const char *>(path, [&](auto & matcher) {
+        return matcher.replay(data, data + length, matches);
+    });
+
+    if (matches.size() == 0) {
+        return false;
+    }
 
-        std::ofstream o2 (path, std::ios::binary | std::ios::out);
-        auto out_iter2 = std::ostream_iterator<char>(o2);
-        for (; begin_in != end_in; begin_in++) {
-            *out_iter2 = *begin_in;
-            out_iter2++;
+    segments = search.segment_count();
+    std::vector<std::uint64_t> offsets(segments + 1, 0);
+    for (std::size_t i = 0; i < segments; i++) {
+        std::uint64_t size = search.segment_end(i) - search.segment_begin(i);
+        for (std::size_t m = search.first_match_of(i); m < search.first_match_of(i+1); m++) {
+            size = size - matches[m].length + search_info.patterns[matches[m].pattern].replacement.literal_text().size();
         }
-        o2.flush();
-        o2.close();
+        offsets[i+1] = offsets[i] + size;
+    }
 
-        if (new_len < old_len) {
-            // truncate path to trunc_len
-#ifdef _WIN32
-            HANDLE handle = CreateFile (
-                path,
-                GENERIC_WRITE,
-                0,
-                NULL,
-                OPEN_EXISTING,
-                NULL,
-                NULL
-            );
-
-            if (handle == INVALID_HANDLE_VALUE) {
-                std::cout << "failed to open truncate file: " << path << std::endl;
-                return false;
+    return replaceFile(path, [&](int fd) {
+        if (ftruncate(fd, offsets[segments]) == -1) {
+            return false;
+        }
+        std::vector<char> ok(segments, 0);
+        auto write_segment = [&](std::size_t i) {
+            OutputWriter writer(fd, src_fd, data, offsets[i]);
+            std::size_t last = search.segment_begin(i);
+            for (std::size_t m = search.first_match_of(i); m < search.first_match_of(i+1); m++) {
+                auto & match = matches[m];
+                writer.copy(last, match.position - last);
+                auto & replacement = search_info.patterns[match.pattern].replacement.literal_text();
+                writer.write_stable(replacement.data(), replacement.size());
+                last = match.position + match.length;
             }
+            writer.copy(last, search.segment_end(i) - last);
+            ok[i] = writer.flush();
+        };
+        parallelFor(segments, write_segment);
+        return std::find(ok.begin(), ok.end(), 0) == ok.end();
+    });
+}
 
-            if (!SetFilePointerEx(handle, (new_len-(old_len - new_len))+2, NULL, FILE_BEGIN)) {
-                std::cout << "failed to set file pointer of truncate file: " << path << std::endl;
-                return false;
-            }
+// the file the pipeline's open stage opened for the scan running on this thread, see scanCaptured
+thread_local const std::string * opened_path = nullptr;
+thread_local int opened_fd = -1;
 
-            if (!SetEndOfFile(handle)) {
-                std::cout << "failed to truncate file: " << path << std::endl;
-                return false;
-            }
+// opens path for reading, from the file the open stage already opened if it is the one being scanned
+int openForReading(const char * path) {
+    if (opened_fd != -1 && opened_path != nullptr && *opened_path == path) {
+        int fd = dup(opened_fd);
+        if (fd != -1 && lseek(fd, 0, SEEK_SET) == 0) return fd;
+        if (fd != -1) close(fd);
+    }
+    return open(path, O_RDONLY);
+}
 
-            CloseHandle(handle);
-#else
-            while (truncate(path, (new_len-(old_len - new_len))+2) == -1) {
+// files up to this size are replaced in memory by replaceSmallFile
+std::size_t small_file_threshold = 1024*1024;
+
+// reads all of fd into buffer, returns false on a read error
+bool readAll(int fd, std::vector<char> & buffer, std::size_t size) {
+    buffer.resize(size);
+    std::size_t got = 0;
+    while (got < size) {
+        auto r = read(fd, buffer.data() + got, size - got);
+        if (r == -1) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        // the file shrunk since it was stat'ed
+        if (r == 0) break;
+        got += r;
+    }
+    buffer.resize(got);
+    return true;
+}
+
+// replaces a small file without mapping it, it is read with a single read into a buffer
+// that is reused across files, the result is built in memory and written with a single write
+//
+// the file is searched once, the matches are replayed to the matcher and then replaced
+//
+// returns false without doing anything if path is not a small regular file, handled is then false
+bool replaceSmallFile(const char * path, bool & handled) {
+    handled = false;
+
+    // reused across files, small files never make them grow past a few times small_file_threshold
+    thread_local std::vector<char> input;
+    thread_local std::string output;
+    thread_local std::vector<std::cmatch> matches;
+
+    int fd = openForReading(path);
+    if (fd == -1) return false;
+
+    struct stat st;
+    if (fstat(fd, &st) == -1 || !S_ISREG(st.st_mode) || st.st_size == 0 || static_cast<std::size_t>(st.st_size) > small_file_threshold) {
+        close(fd);
+        return false;
+    }
+
+    bool ok = readAll(fd, input, st.st_size);
+    close(fd);
+    if (!ok) return false;
+
+    handled = true;
+
+    auto regex_flags = std::regex::ECMAScript | std::regex::optimize;
+    if (ignore_case) regex_flags |= std::regex::icase;
+    std::regex e(search_info.search, regex_flags);
+
+    const char * begin = input.data();
+    const char * end = begin + input.size();
+
+    out() << "searching file '" << path << "' with a length of " << std::to_string(input.size()) << " bytes ..." << '\n';
+    out() << "using read api" << '\n';
+    matches.clear();
+    for (std::regex_iterator<const char *> it(begin, end, e), it_end; it != it_end; ++it) {
+        // empty matches are replaced too, replay does not report them
+        matches.push_back(*it);
+    }
+    bool found = withMatcher<const char *>(path, [&](auto & matcher) {
+        return matcher.replay(begin, end, matches);
+    });
+    if (!found) {
+        return false;
+    }
+
+    output.clear();
+    const char * last = begin;
+    for (auto & m : matches) {
+        output.append(last, m[0].first);
+        search_info.replacement_for(m).format(m, output);
+        last = m[0].second;
+    }
+    output.append(last, end);
+
+    bool replaced = replaceFile(path, [&](int out_fd) {
+        const char * data = output.data();
+        std::size_t length = output.size();
+        while (length != 0) {
+            auto w = write(out_fd, data, length);
+            if (w == -1) {
                 if (errno == EINTR) continue;
-                std::cout << "failed to truncate file: " << path << std::endl;
                 return false;
             }
-#endif
+            data += w;
+            length -= w;
         }
         return true;
+    });
+
+    if (output.capacity() > 4*small_file_threshold) {
+        std::string().swap(output);
     }
+    if (matches.capacity() > small_file_threshold) {
+        std::vector<std::cmatch>().swap(matches);
+    }
+    return replaced;
 }
 
-std::stringstream * toMemFile(std::istream * inHandle, unsigned int s, unsigned int buffer_length) {
-    std::cout << "copying file to memory file" << std::endl;
-    std::stringstream * memFile = new std::stringstream(std::ios::binary | std::ios::in | std::ios::out);
-    unsigned int s_r = 0;
-    unsigned int s_w = 0;
+// what is done with files whose first block looks binary, see --binary
+enum BinaryFiles {
+    BINARY_SKIP,
+    BINARY_TEXT,
+    BINARY_REPORT
+};
+
+BinaryFiles binary_files = BINARY_SKIP;
 
-    char buffer[buffer_length];
-    unsigned int s_c = s > buffer_length ? buffer_length : s;
-    while (!inHandle->eof()) {
-        inHandle->read(buffer, s_c);
-        if (inHandle->gcount() == 0) {
+// the files named on the command line, filled in before any is scanned
+std::unordered_set<std::string> named_files;
+
+// what is done with a binary file, one the user named, or stdin, is never skipped
+BinaryFiles binaryFiles(bool named) {
+    return named && binary_files == BINARY_SKIP ? BINARY_TEXT : binary_files;
+}
+
+// reads the first block of path, true if it looks binary
+bool sniffBinary(const char * path) {
+    int fd = openForReading(path);
+    if (fd == -1) return false;
+    char block[BINARY_SNIFF_SIZE];
+    std::size_t got = 0;
+    while (got < sizeof(block)) {
+        auto r = read(fd, block + got, sizeof(block) - got);
+        if (r == -1) {
+            if (errno == EINTR) continue;
             break;
         }
-        s_r += inHandle->gcount();
-        memFile->write(buffer, inHandle->gcount());
-        memFile->flush();
-        std::cout << "wrote " << inHandle->gcount() << " bytes" << std::endl;
-        s_w += inHandle->gcount();
-        if (s_r == s) {
-            std::cout << s_r << " == " << s << std::endl;
-            break;
+        if (r == 0) break;
+        got += r;
+    }
+    close(fd);
+    return looks_binary(block, got);
+}
+
+// searches a binary file only for whether it matches, its matches are not printed nor replaced
+bool reportBinary(const char * path, const char * name, std::regex & e) {
+    bool found;
+    if (use_mmap) {
+        MMapHelper map(path, 'r');
+        auto length = map.length();
+        if (!map.is_open() || length == 0) return false;
+        auto whole = map.obtain_map(0, length);
+        if (whole.get() != nullptr) {
+            auto data = static_cast<const char *>(whole->get());
+            found = std::regex_search(data, data + length, e);
         } else {
-            unsigned int ss = s - s_r;
-            s_c = ss > buffer_length ? buffer_length : ss;
-        }
-        if (!inHandle->eof() && (inHandle->bad() || inHandle->fail())) {
-            std::cout << "failed to read " << s_c << " bytes (" << s_r << " of " << s << " bytes)" << std::endl;
-            break;
+            found = std::regex_search(MMapIterator(map, 0), MMapIterator(map, length), e);
         }
+    } else {
+        auto stream = std::ifstream(path, std::ios::binary | std::ios::in);
+        found = std::regex_search(ifstream_iterator(stream, 0), ifstream_iterator(stream), e);
+    }
+    if (found) {
+        out() << "binary file matches: " << name << '\n';
     }
-    std::cout << "copied file to memory file" << std::endl;
-    return memFile;
+    return found;
 }
 
-void toOutStream(std::istream * inHandle, std::ostream * outHandle, unsigned int s, unsigned int buffer_length) {
-    std::cout << "copying file to out stream" << std::endl;
-    unsigned int s_r = 0;
-    unsigned int s_w = 0;
+// when searching, skip files whose contents are identical to a file searched before
+bool dedupe_content = false;
 
-    char buffer[buffer_length];
-    unsigned int s_c = s > buffer_length ? buffer_length : s;
-    while (!inHandle->eof()) {
-        inHandle->read(buffer, s_c);
-        if (inHandle->gcount() == 0) {
-            break;
+struct ContentKey {
+    std::size_t length;
+    std::size_t hash;
+
+    bool operator==(const ContentKey & other) const {
+        return length == other.length && hash == other.hash;
+    }
+};
+
+struct ContentKeyHash {
+    std::size_t operator()(const ContentKey & key) const {
+        return key.hash;
+    }
+};
+
+// the first file searched with the given length and contents hash
+ShardedMap<ContentKey, std::string, ContentKeyHash> contents_searched;
+
+// true if a file with the same contents as data was searched already, a hash match
+// is confirmed by comparing both files before path is skipped
+bool sameContentsSearched(const char * path, const char * data, std::size_t length) {
+    ContentKey key = {length, std::hash<std::string_view>()(std::string_view(data, length))};
+    std::string first;
+    if (contents_searched.insert(key, path, first)) return false;
+
+    MMapHelper other(first.c_str(), 'r');
+    if (!other.is_open() || other.length() != length) return false;
+    auto other_map = other.obtain_map(0, length);
+    if (other_map.get() == nullptr || memcmp(other_map->get(), data, length) != 0) return false;
+
+    out() << "skipping file '" << path << "', same contents as '" << first << "'" << '\n';
+    return true;
+}
+
+// with --to-stdout, writes the contents of path to stdout, with every match replaced if `replace`
+bool writeToStdout(const char * path, const char * name, std::regex & e, bool replace) {
+    int src_fd = openForReading(path);
+    if (src_fd == -1) {
+        out() << "failed to open file: " << name << '\n';
+        return false;
+    }
+    bool written;
+    std::uint64_t copied;
+    MMapHelper map;
+    std::shared_ptr<MMapHelper::Page> whole;
+    if (replace) {
+        map = MMapHelper(path, 'r');
+        if (map.is_open() && map.length() != 0) whole = map.obtain_map(0, map.length());
+    }
+    if (!replace || !map.is_open() || map.length() == 0) {
+        written = spool(src_fd, stdout_fd, copied);
+    } else if (whole.get() != nullptr) {
+        out() << "writing file '" << name << "' with a length of " << std::to_string(map.length()) << " bytes to stdout ..." << '\n';
+        const char * data = static_cast<const char *>(whole->get());
+        written = replaceContiguous(data, map.length(), src_fd, stdout_fd, RegexMatches<const char *>{{data, data + map.length(), e}});
+    } else {
+        out() << "writing file '" << name << "' with a length of " << std::to_string(map.length()) << " bytes to stdout ..." << '\n';
+        written = writeStream(stdout_fd, [&](std::ostream & o) {
+            replaceStream(MMapIterator(map, 0), MMapIterator(map, map.length()), e, o);
+        });
+    }
+    close(src_fd);
+    if (!written) {
+        out() << "failed to write file '" << name << "' to stdout" << '\n';
+    }
+    return written;
+}
+
+// named is true for a file the user named, and for stdin
+//
+// a search prints what it finds in path as found in `name`, path unless given
+bool invokeMMAP(const char * path, bool named = false, const char * name = nullptr) {
+    auto regex_flags = std::regex::ECMAScript | std::regex::optimize;
+    if (ignore_case) regex_flags |= std::regex::icase;
+    if (name == nullptr) name = path;
+
+    // decided on the first block alone, before the file is mapped
+    auto binary = binaryFiles(named);
+    if (binary != BINARY_TEXT && sniffBinary(path)) {
+        if (to_stdout) {
+            // a filter never drops data, a binary file goes through unchanged
+            out() << "writing binary file unchanged: " << name << '\n';
+            std::regex e(search_info.search, regex_flags);
+            return writeToStdout(path, name, e, false);
         }
-        s_r += inHandle->gcount();
-        outHandle->write(buffer, inHandle->gcount());
-        outHandle->flush();
-        std::cout << "wrote " << inHandle->gcount() << " bytes" << std::endl;
-        s_w += inHandle->gcount();
-        if (s_r == s) {
-            std::cout << s_r << " == " << s << std::endl;
-            break;
+        if (binary == BINARY_SKIP) {
+            out() << "skipping binary file: " << name << '\n';
+            return false;
+        }
+        std::regex e(search_info.search, regex_flags);
+        return reportBinary(path, name, e);
+    }
+
+    if (search_info.searching) {
+
+        if (use_mmap) {
+            MMapHelper map(path, 'r');
+
+            auto map_len = map.length();
+
+            if (map.is_open() && map_len == 0) {
+                out() << "skipping zero length file: " << name << '\n';
+                return false;
+            }
+
+            if (!map.is_open()) {
+                out() << "failed to open file: " << name << '\n';
+                return false;
+            }
+
+            if (dedupe_content) {
+                auto whole = map.obtain_map(0, map_len);
+                if (whole.get() != nullptr && sameContentsSearched(path, static_cast<const char *>(whole->get()), map_len)) {
+                    return false;
+                }
+            }
+
+            std::regex e(search_info.search, regex_flags);
+
+            std::size_t segments = segmentCount(map_len);
+            if (segments > 1) {
+                auto whole = map.obtain_map(0, map_len);
+                if (whole.get() != nullptr) {
+                    return searchSegmented(path, name, static_cast<const char *>(whole->get()), map_len, e, segments);
+                }
+            }
+
+            MMapIterator begin(map, 0);
+            MMapIterator end(map, map_len);
+
+            out() << "searching file '" << name << "' with a length of " << std::to_string(map_len) << " bytes ..." << '\n';
+            out() << "using mmap api" << '\n';
+            // for (auto begin_ = begin; begin_ != end; begin_++) {
+            //     auto c = *begin_;
+            // }
+            // return true;
+            return withMatcher<MMapIterator>(path, [&](auto & matcher) {
+                return matcher.search(begin, end, e);
+            }, true, name);
         } else {
-            unsigned int ss = s - s_r;
-            s_c = ss > buffer_length ? buffer_length : ss;
+            std::regex e(search_info.search, regex_flags);
+
+            out() << "searching file '" << name << "' ..." << '\n';
+            out() << "using ifstream api" << '\n';
+            auto stream = std::ifstream(path, std::ios::binary | std::ios::in);
+            // for (std::string line; std::getline(stream, line); ) {
+
+            // }
+            // return true;
+            auto begin = ifstream_iterator(stream, 0);
+            auto end = ifstream_iterator(stream);
+            // for (auto begin_ = begin; begin_ != end; begin_++) {
+            //     auto c = *begin_;
+            // }
+            // return true;
+            return withMatcher<ifstream_iterator>(path, [&](auto & matcher) {
+                return matcher.search(begin, end, e);
+            }, true, name);
         }
-        if (!inHandle->eof() && (inHandle->bad() || inHandle->fail())) {
-            std::cout << "failed to read " << s_c << " bytes (" << s_r << " of " << s << " bytes)" << std::endl;
-            break;
+    } else {
+
+        if (to_stdout) {
+            std::regex e(search_info.search, regex_flags);
+            return writeToStdout(path, name, e, true);
+        }
+
+        if (use_mmap && !in_place) {
+            bool handled;
+            bool replaced = replaceSmallFile(path, handled);
+            if (handled) return replaced;
+        }
+
+        if (use_mmap) {
+            MMapHelper map(path, 'r');
+
+            auto old_len = map.length();
+
+            if (map.is_open() && old_len == 0) {
+                out() << "skipping zero length file: " << path << '\n';
+                return false;
+            }
+
+            if (!map.is_open()) {
+                out() << "failed to open file: " << path << '\n';
+                return false;
+            }
+
+            std::regex e(search_info.search, regex_flags);
+
+            bool fixed_length = std::all_of(search_info.patterns.begin(), search_info.patterns.end(), [](const Pattern & p) {
+                return p.replacement.is_literal();
+            });
+            std::size_t segments = segmentCount(old_len);
+            if (!in_place && segments > 1 && fixed_length) {
+                auto whole = map.obtain_map(0, old_len);
+                if (whole.get() != nullptr) {
+                    int src_fd = openForReading(path);
+                    bool replaced = replaceSegmented(path, static_cast<const char *>(whole->get()), old_len, src_fd, e, segments);
+                    if (src_fd != -1) close(src_fd);
+                    return replaced;
+                }
+            }
+
+            out() << "searching file '" << path << "' with a length of " << std::to_string(map.length()) << " bytes ..." << '\n';
+            out() << "using mmap api" << '\n';
+
+            auto whole = map.obtain_map(0, old_len);
+            if (whole.get() != nullptr) {
+                // with the whole file mapped at once, it is searched once as by replaceSmallFile, the matches
+                // are replayed to the matcher and then patched in place or replaced around slices of the mapping
+                const char * data = static_cast<const char *>(whole->get());
+                std::vector<std::cmatch> matches;
+                for (std::cregex_iterator it(data, data + old_len, e), it_end; it != it_end; ++it) {
+                    matches.push_back(*it);
+                }
+                bool found = withMatcher<const char *>(path, [&](auto & matcher) {
+                    return matcher.replay(data, data + old_len, matches);
+                });
+                if (!found) {
+                    return false;
+                }
+
+                if (in_place) {
+                    std::vector<InPlacePatch> patches;
+                    if (collectInPlacePatches(data, matches, patches)) {
+                        return patchInPlace(path, patches);
+                    }
+                    out() << "replacement changes the length of a match, rewriting file instead of patching in place" << '\n';
+                }
+
+                int src_fd = openForReading(path);
+                bool replaced = replaceFile(path, [&](int fd) {
+                    return replaceContiguous(data, old_len, src_fd, fd, matches);
+                });
+                if (src_fd != -1) close(src_fd);
+                return replaced;
+            }
+
+            // page by page, keeping every match would keep its pages mapped, so each pass searches again
+            MMapIterator begin(map, 0);
+            MMapIterator end(map, old_len);
+
+            bool found = withMatcher<MMapIterator>(path, [&](auto & matcher) {
+                return matcher.search(begin, end, e);
+            });
+            if (!found) {
+                return false;
+            }
+
+            if (in_place) {
+                std::vector<InPlacePatch> patches;
+                if (collectInPlacePatches(begin, RegexMatches<MMapIterator>{{begin, end, e}}, patches)) {
+                    return patchInPlace(path, patches);
+                }
+                out() << "replacement changes the length of a match, rewriting file instead of patching in place" << '\n';
+            }
+
+            return replaceFile(path, [&](int fd) {
+                return writeStream(fd, [&](std::ostream & o) {
+                    replaceStream(begin, end, e, o);
+                });
+            });
+
+            // end of mmap scope
+        } else {
+            std::regex e(search_info.search, regex_flags);
+
+            out() << "searching file '" << path << "' ..." << '\n';
+            out() << "using ifstream api" << '\n';
+            auto stream = std::ifstream(path, std::ios::binary | std::ios::in);
+
+            ifstream_iterator::State stream_init;
+            stream_init.save(&stream);
+
+            auto begin = ifstream_iterator(stream, 0);
+            auto end = ifstream_iterator(stream);
+
+            bool found = withMatcher<ifstream_iterator>(path, [&](auto & matcher) {
+                return matcher.search(begin, end, e);
+            });
+            if (!found) {
+                return false;
+            }
+
+            return replaceFile(path, [&](int fd) {
+                return writeStream(fd, [&](std::ostream & o) {
+                    stream_init.restore(&stream);
+                    auto begin_ = ifstream_iterator(stream, 0);
+                    auto end_ = ifstream_iterator(stream);
+                    replaceStream(begin_, end_, e, o);
+                });
+            });
         }
     }
-    std::cout << "copied file to out stream" << std::endl;
 }
 
-void invoke_dir(const std::string & path)
+// --largest-first, the pipeline scans the largest files it knows of first
+bool largest_first = false;
+
+// --unordered, the pipeline prints the output of each file as soon as it is scanned,
+// instead of in the order the files are found
+bool unordered = false;
+
+void scanFile(const std::string & path) {
+    if (pipeline == nullptr) {
+        invokeMMAP(path.c_str(), named_files.count(path) != 0);
+        flushOutput();
+    } else if (largest_first) {
+        struct stat st;
+        pipeline->submit(path, stat(path.c_str(), &st) == 0 ? st.st_size : 0);
+    } else {
+        pipeline->submit(path);
+    }
+}
+
+// the scan stage of the pipeline
+//
+// with --json only the records are captured, the messages go straight to stderr
+//
+// a scan that printed part of its output itself, see printFromFile, also prints the rest
+void scanCaptured(const std::string & path, int fd, std::string & text) {
+    output_buffer.begin_capture();
+    opened_path = &path;
+    opened_fd = fd;
+    invokeMMAP(path.c_str(), named_files.count(path) != 0);
+    opened_path = nullptr;
+    opened_fd = -1;
+    if (output_buffer.is_capturing()) {
+        output_buffer.end_capture(text);
+    } else {
+        output_buffer.flush();
+        text.clear();
+    }
+    if (json_output) message_buffer.flush();
+}
+
+// the emit stage of the pipeline
+void emitCaptured(const std::string & text) {
+    stdout_sink.write(text.data(), text.size());
+}
+
+// how files found by the walk are ordered before they are scanned, see --sort-files
+enum SortFiles {
+    SORT_NONE,
+    SORT_INODE,
+    SORT_EXTENT
+};
+
+SortFiles sort_files = SORT_NONE;
+
+// the number of files --sort-files orders at a time
+const std::size_t LOCALITY_BATCH_SIZE = 4096;
+
+// batches files for --sort-files, nullptr without it
+LocalityBatch * locality = nullptr;
+
+// hands a file found by the walk on to be scanned, after ordering it into a batch with --sort-files
+void queueFile(const std::string & path, std::uint64_t inode) {
+    if (locality == nullptr) {
+        scanFile(path);
+    } else {
+        locality->add(path, sort_files == SORT_EXTENT ? first_physical_offset(path.c_str()) : inode);
+    }
+}
+
+// prints a message that does not belong to the output of a single file, in its place
+// among the output of the files around it unless --unordered
+void report(const char * message, const std::string & path) {
+    if (pipeline != nullptr && !unordered && !json_output) {
+        pipeline->submit_output(message + path + '\n');
+        return;
+    }
+    out() << message << path << '\n';
+    out().flush();
+}
+
+// runs task on the pool if there is one, otherwise right away
+template <typename Task>
+void schedule(Task && task) {
+    if (pool == nullptr) {
+        task();
+    } else {
+        pool->submit(std::forward<Task>(task));
+    }
+}
+
+// the ignore file rules that apply to a directory's entries
+using IgnoreRules = std::shared_ptr<const IgnoreLevel>;
+
+// every directory walked so far, with the path it was first found under, and every file,
+// of which there are far more, by its id alone
+ShardedMap<FileId, std::string, FileIdHash> visited_directories;
+ShardedSet<FileId, FileIdHash> visited_files;
+
+// true the first time a file or directory is found, hard links, overlapping paths and
+// symbolic links to something already walked are skipped, which also ends symbolic link loops
+bool firstVisit(const FileId & id, const std::string & path, bool directory) {
+    if (!directory) {
+        if (visited_files.insert(id)) return true;
+        report("skipping, already searched:  ", path);
+        return false;
+    }
+    std::string first;
+    if (visited_directories.insert(id, path, first)) return true;
+    report("skipping, already searched:  ", path + " (as " + first + ")");
+    return false;
+}
+
+#ifdef __linux__
+// a sub directory found while reading its parent, opened once the parent has been read to the end
+struct PendingDirectory {
+    std::shared_ptr<DirWalker> parent;
+    std::string name;
+    IgnoreRules rules;
+};
+
+// reads a directory with getdents64, queues its files and adds its sub directories to `children`
+//
+// entries path_filter skips are dropped here, so a skipped directory is never opened
+void readDirectory(const std::shared_ptr<DirWalker> & dir, const IgnoreRules & parent_rules, std::size_t root_length, std::vector<PendingDirectory> & children) {
+    IgnoreRules rules = path_filter.enter(parent_rules, dir->get_path(), dir->get_fd());
+    bool ok = dir->for_each([&](const char * name, DirWalker::Type type, const FileId & id) {
+        std::string path = dir->child_path(name);
+        if (path_filter.skip(rules.get(), path, path.size() - strlen(name), root_length, type == DirWalker::DIRECTORY)) {
+            return;
+        }
+        switch (type) {
+            case DirWalker::REGULAR:
+                if (firstVisit(id, path, false)) {
+                    queueFile(path, id.inode);
+                }
+                break;
+            case DirWalker::DIRECTORY:
+                children.push_back({dir, name, rules});
+                break;
+            case DirWalker::MISSING:
+                report("item does not exist:  ", path);
+                break;
+            case DirWalker::OTHER:
+                report("unknown type:  ", path);
+                break;
+        }
+    });
+    if (!ok) {
+        report("failed to read directory:  ", dir->get_path());
+    }
+}
+
+// opens a sub directory relative to its parent, null if it cannot be or was walked before
+std::shared_ptr<DirWalker> openChild(const PendingDirectory & child) {
+    auto dir = child.parent->open_child(child.name.c_str());
+    if (dir == nullptr) {
+        report("failed to open directory:  ", child.parent->child_path(child.name.c_str()));
+        return nullptr;
+    }
+    // the entry's inode is not the mounted directory's if it is a mount point, the open directory's is
+    if (!firstVisit(dir->get_id(), dir->get_path(), true)) return nullptr;
+    return dir;
+}
+
+void walkDirectory(const std::shared_ptr<DirWalker> & dir, const IgnoreRules & rules, std::size_t root_length);
+
+void walkChild(const PendingDirectory & child, std::size_t root_length) {
+    auto dir = openChild(child);
+    if (dir != nullptr) walkDirectory(dir, child.rules, root_length);
+}
+
+// walks a directory and everything below it, sub directories are opened relative to their parent,
+// with a pool every sub directory is a task of its own
+//
+// without a pool they are walked depth first from a stack, each once its parent has been read
+// to the end, so no getdents64 buffer is held while a sub directory is walked, and only the
+// descriptors of directories that still have sub directories left to walk stay open
+void walkDirectory(const std::shared_ptr<DirWalker> & dir, const IgnoreRules & rules, std::size_t root_length) {
+    std::vector<PendingDirectory> pending;
+    readDirectory(dir, rules, root_length, pending);
+    if (pool != nullptr) {
+        for (auto & child : pending) {
+            pool->submit([child, root_length] { walkChild(child, root_length); });
+        }
+        return;
+    }
+    // the stack is popped from the back, reversed the sub directories are walked in the order they were found
+    std::reverse(pending.begin(), pending.end());
+    while (!pending.empty()) {
+        PendingDirectory child = std::move(pending.back());
+        pending.pop_back();
+        auto sub = openChild(child);
+        if (sub == nullptr) continue;
+        std::size_t found = pending.size();
+        readDirectory(sub, child.rules, root_length, pending);
+        std::reverse(pending.begin() + found, pending.end());
+    }
+}
+
+// paths given on the command line are never skipped, only what is found below them
+void visit(const std::string & path)
+{
+    struct stat st;
+    if (stat(path.c_str(), &st) == -1) {
+        report("item does not exist:  ", path);
+    } else if (S_ISDIR(st.st_mode)) {
+        auto dir = DirWalker::open(path);
+        if (dir == nullptr) {
+            report("failed to open directory:  ", path);
+            return;
+        }
+        if (!firstVisit(dir->get_id(), path, true)) return;
+        walkDirectory(dir, nullptr, path.size());
+    } else if (S_ISREG(st.st_mode)) {
+        if (!firstVisit({static_cast<std::uint64_t>(st.st_dev), static_cast<std::uint64_t>(st.st_ino)}, path, false)) return;
+        queueFile(path, st.st_ino);
+    } else {
+        report("unknown type:  ", path);
+    }
+}
+#else
+// firstVisit for a path, windows has no inode numbers to tell files apart by
+bool firstVisit(const std::string & path) {
+#ifdef _WIN32
+    return true;
+#else
+    struct stat st;
+    if (stat(path.c_str(), &st) == -1) return true;
+    return firstVisit({static_cast<std::uint64_t>(st.st_dev), static_cast<std::uint64_t>(st.st_ino)}, path, S_ISDIR(st.st_mode));
+#endif
+}
+
+void walkEntry(const std::string & path, const IgnoreRules & rules, std::size_t root_length);
+
+// lists a directory, with a pool every entry of a directory is a task of its own
+//
+// the directory is listed to the end before its entries are walked, so its listing is not
+// held open while the directories below it are walked
+void walkDirectory(const std::string & path, cppfs::FileHandle & handle, const IgnoreRules & parent_rules, std::size_t root_length)
+{
+    IgnoreRules rules = path_filter.enter(parent_rules, path);
+    std::vector<std::string> children;
+    for (cppfs::FileIterator it = handle.begin(); it != handle.end(); ++it)
+    {
+        children.push_back(path + "/" + *it);
+    }
+    for (auto & child : children)
+    {
+        schedule([child, rules, root_length] { walkEntry(child, rules, root_length); });
+    }
+}
+
+// entries path_filter skips are dropped here, so a skipped directory is never listed
+void walkEntry(const std::string & path, const IgnoreRules & rules, std::size_t root_length)
 {
     cppfs::FileHandle handle = cppfs::fs::open(path);
+    bool is_directory = handle.isDirectory();
+    if (path_filter.skip(rules.get(), path, path.find_last_of('/') + 1, root_length, is_directory)) {
+        return;
+    }
 
     if (!handle.exists()) {
-        std::cout << "item does not exist:  " << path << std::endl;
+        report("item does not exist:  ", path);
+    } else if (!firstVisit(path)) {
         return;
+    } else if (is_directory) {
+        walkDirectory(path, handle, rules, root_length);
+    } else if (handle.isFile()) {
+        // no inode numbers from cppfs, --sort-files inode keeps the directory order
+        queueFile(path, 0);
+    } else {
+        report("unknown type:  ", path);
     }
+}
 
-    if (handle.isDirectory())
-    {
-        // std::cout << "entering directory:  " << path << std::endl;
-        for (cppfs::FileIterator it = handle.begin(); it != handle.end(); ++it)
-        {
-            invoke_dir(path + "/" + *it);
-        }
-        // std::cout << "leaving directory:  " << path << std::endl;
+// paths given on the command line are never skipped, only what is found below them
+void visit(const std::string & path)
+{
+    cppfs::FileHandle handle = cppfs::fs::open(path);
+
+    if (!handle.exists()) {
+        report("item does not exist:  ", path);
+    } else if (!firstVisit(path)) {
+        return;
+    } else if (handle.isDirectory()) {
+        walkDirectory(path, handle, nullptr, path.size());
     } else if (handle.isFile()) {
-        invokeMMAP(path.c_str());
+        // no inode numbers from cppfs, --sort-files inode keeps the directory order
+        queueFile(path, 0);
     } else {
-        std::cout << "unknown type:  " << path << std::endl;
+        report("unknown type:  ", path);
+    }
+}
+#endif
+
+// visits path, on the pool if there is one, call waitForScans() for it to finish
+void invoke_dir(const std::string & path)
+{
+    schedule([path] { visit(path); });
+}
+
+// with more than one job, the files found go through a pipeline that scans that many files at a time
+//
+// the output is in the order the files are found, which only stays the same from run to run if a
+// single thread walks the directories, with --unordered they are walked on a pool of that many
+// threads and each file is printed as soon as it is scanned
+void startScans() {
+    // with --to-stdout the contents of the files are written one after another, in the order they are found
+    if (jobs > 1 && !to_stdout && pipeline == nullptr) {
+        if (unordered) pool = new ThreadPool(jobs);
+        pipeline = new ScanPipeline(2, jobs, scanCaptured, emitCaptured, largest_first, !unordered);
+    }
+    if (sort_files != SORT_NONE && locality == nullptr) {
+        locality = new LocalityBatch(LOCALITY_BATCH_SIZE, scanFile);
+    }
+}
+
+// waits for everything invoke_dir started, then for the pipeline to drain
+void waitForScans() {
+    if (pool != nullptr) {
+        pool->wait();
+        delete pool;
+        pool = nullptr;
+    }
+    if (locality != nullptr) {
+        locality->flush();
+        delete locality;
+        locality = nullptr;
+    }
+    if (pipeline != nullptr) {
+        pipeline->finish();
+        if (print_stats) {
+            std::cout << std::endl;
+            pipeline->print_stats(std::cout);
+        }
+        delete pipeline;
+        pipeline = nullptr;
     }
 }
 
@@ -880,14 +2169,354 @@ void invoke_dir(const std::string & path)
 #define REOPEN_STDIN_AS_BINARY() freopen(NULL, "rb", stdin)
 #endif
 
-#define GET_STDIN_SIZE(size_name) \
-   unsigned int size_name = 0; \
-   while (true) { \
-      char tmp[1]; \
-      unsigned int r = fread(tmp, 1, 1, stdin); \
-      if (r == 0) break; \
-      size_name += r; \
-   }
+// what stdin is called where a path is printed, in line prefixes, --json and --binary-results
+const char * const STDIN_NAME = "<stdin>";
+
+// the window streamStdin searches stdin in, it only grows to hold a longer line
+const std::size_t STREAM_BUFFER_SIZE = 1024*1024;
+
+// a line of stdin longer than this is passed on without being searched, the window would
+// otherwise grow without bound for a stream without newlines
+const std::size_t STREAM_MAX_LINE_LENGTH = 64*1024*1024;
+
+// stdin can be searched as it arrives if the window it is searched in can be bounded,
+// as for searching a file in segments, and nothing is replaced in place
+bool canStream() {
+    return (search_info.searching || to_stdout) && canSegment();
+}
+
+// searches stdin as it arrives and prints every match as soon as it is complete, so a
+// never ending stream such as the output of 'tail -f' is searched too, with --to-stdout
+// the replaced stream is written out the same way
+bool streamStdin() {
+    auto regex_flags = std::regex::ECMAScript | std::regex::optimize;
+    if (ignore_case) regex_flags |= std::regex::icase;
+    std::regex e(search_info.search, regex_flags);
+
+    bool lines = use_regex && match_within_lines;
+    StreamSearch search(e, lines ? 0 : maxMatchLength(), lines, STREAM_BUFFER_SIZE, STREAM_MAX_LINE_LENGTH);
+
+    bool first_block = true;
+    bool report_only = false;
+    auto read_stdin = [&](char * buffer, std::size_t size) -> std::ptrdiff_t {
+        std::ptrdiff_t r;
+        do {
+            r = read(0, buffer, size);
+        } while (r == -1 && errno == EINTR);
+        if (first_block && r > 0) {
+            first_block = false;
+            // decided on whatever arrives first, waiting for a whole block could wait forever
+            if (binaryFiles(true) != BINARY_TEXT && looks_binary(buffer, std::min<std::size_t>(r, BINARY_SNIFF_SIZE))) {
+                // stdin is never skipped, so only --binary report gets here
+                if (to_stdout) {
+                    // a filter never drops data, binary input goes through unchanged
+                    out() << "writing binary stdin unchanged" << '\n';
+                }
+                report_only = true;
+            }
+        }
+        return r;
+    };
+
+    bool found;
+    bool read_failed;
+    bool write_failed = false;
+    if (to_stdout) {
+        out() << "replacing stdin as it arrives, writing it to stdout ..." << '\n';
+        OutputWriter writer(stdout_fd, -1, nullptr);
+        found = search.run(read_stdin, [&](const char * begin, const char * end, const std::cmatch * m) {
+            // spans stay valid until the flush after the block they were found in
+            if (m == nullptr || report_only) {
+                writer.write_stable(begin, end - begin);
+                return;
+            }
+            search_info.replacement_for(*m).apply(*m, [&](const char * data, std::size_t length, bool stable) {
+                if (stable) {
+                    writer.write_stable(data, length);
+                } else {
+                    writer.write(data, length);
+                }
+            });
+        }, [&] {
+            return writer.flush();
+        }, read_failed);
+        write_failed = !writer.flush();
+    } else {
+        out() << "searching stdin as it arrives ..." << '\n';
+        withMatcher<const char *>(STDIN_NAME, [&](auto & matcher) {
+            // the offset of the next span in the stream
+            std::uint64_t offset = 0;
+            found = search.run(read_stdin, [&](const char * begin, const char * end, const std::cmatch * m) {
+                offset += end - begin;
+                if (report_only) return;
+                matcher.current_offset = offset - (end - begin);
+                if (m != nullptr) {
+                    // as by replay, an empty match is not printed
+                    if (begin == end) return;
+                    matcher.current_match = m;
+                    if (matcher.log != nullptr) matcher.log_match(matcher.current_offset, end - begin, search_info.pattern_index(*m));
+                    matcher.onMatch(&matcher, {begin, end});
+                } else if (!silent) {
+                    matcher.onNonMatch(&matcher, {begin, end});
+                }
+            }, [] {
+                // a match is printed as soon as the block it was found in is searched
+                flushOutput();
+                return true;
+            }, read_failed);
+            if (!report_only) matcher.onFinish(&matcher);
+            return found;
+        }, false);
+    }
+
+    if (read_failed) {
+        out() << "failed to read stdin after " << std::to_string(search.size()) << " bytes" << '\n';
+    } else if (write_failed) {
+        out() << "failed to write to stdout after reading " << std::to_string(search.size()) << " bytes" << '\n';
+    } else {
+        out() << (to_stdout ? "replaced " : "searched ") << std::to_string(search.size()) << " bytes of stdin" << '\n';
+    }
+    if (search.skipped_lines() != 0) {
+        out() << "stdin lines not searched, longer than " << std::to_string(STREAM_MAX_LINE_LENGTH) << " bytes: " << std::to_string(search.skipped_lines()) << '\n';
+    }
+    if (report_only && found && !to_stdout) {
+        out() << "binary file matches: " << STDIN_NAME << '\n';
+    }
+    return found;
+}
+
+// true if stdin is a regular file that has not been read from yet, it can then be
+// opened again by path and mapped like any other file
+bool stdinIsFile() {
+#ifdef _WIN32
+    return false;
+#else
+    struct stat st;
+    return fstat(0, &st) == 0 && S_ISREG(st.st_mode) && lseek(0, 0, SEEK_CUR) == 0;
+#endif
+}
+
+// searches or replaces stdin
+//
+// a regular file is searched where it is, otherwise stdin is searched as it arrives if it can
+// be, or else copied into memory, or for a replacement into a temporary file, and searched there,
+// with --to-stdout nothing is replaced in place so memory does for replacements too
+bool invokeStdin() {
+    if ((search_info.searching || to_stdout) && stdinIsFile()) {
+        out() << "stdin is a file, searching it in place" << '\n';
+        return invokeMMAP("/dev/fd/0", true, STDIN_NAME);
+    }
+
+    if (canStream()) {
+        return streamStdin();
+    }
+
+    std::uint64_t size;
+    if (search_info.searching || to_stdout) {
+        int fd = memory_file("FindReplace__stdin_");
+        if (fd != -1) {
+            if (!spool(0, fd, size)) {
+                std::cout << "failed to read stdin after " << std::to_string(size) << " bytes" << std::endl;
+                close(fd);
+                return false;
+            }
+            std::cout << "copied " << std::to_string(size) << " bytes of stdin into memory" << std::endl;
+            bool found = invokeMMAP(("/proc/self/fd/" + std::to_string(fd)).c_str(), true, STDIN_NAME);
+            close(fd);
+            return found;
+        }
+    }
+
+    // a replacement is written next to the file being replaced, which needs a directory
+    TempFile tmp_file("FindReplace__stdin_");
+
+    std::cout << "created temporary file: " << tmp_file.get_path() << std::endl;
+
+    int fd = open(tmp_file.get_path().c_str(), O_WRONLY | O_TRUNC);
+    if (fd == -1) {
+        std::cout << "failed to open temporary file: " << tmp_file.get_path() << std::endl;
+        return false;
+    }
+    bool ok = spool(0, fd, size);
+    close(fd);
+    if (!ok) {
+        std::cout << "failed to read stdin after " << std::to_string(size) << " bytes" << std::endl;
+        return false;
+    }
+    std::cout << "copied " << std::to_string(size) << " bytes of stdin into the temporary file" << std::endl;
+
+    return invokeMMAP(tmp_file.get_path().c_str(), true);
+}
+
+Pattern makePattern(const std::string & item) {
+    Pattern p;
+    if (use_regex) {
+        p.search = item;
+    } else {
+        p.search = unescape(item, true, false);
+        p.length = unescape(item, false, true, false).size();
+    }
+    return p;
+}
+
+// reads one "search<TAB>replacement" pair per line, both sides are unescaped like
+// command line arguments, empty lines and lines starting with '#' are skipped
+bool readMappingFile(const char * path, std::vector<Pattern> & patterns) {
+    std::ifstream file(path, std::ios::binary | std::ios::in);
+    if (!file) {
+        std::cout << "failed to open mapping file: " << path << std::endl;
+        return false;
+    }
+    std::string line;
+    for (std::size_t n = 1; std::getline(file, line); n++) {
+        if (line.size() != 0 && line.back() == '\r') line.pop_back();
+        if (line.size() == 0 || line[0] == '#') continue;
+        auto tab = line.find('\t');
+        if (tab == std::string::npos || tab == 0) {
+            std::cout << "mapping file " << path << ":" << std::to_string(n) << " must be 'search<TAB>replacement'" << std::endl;
+            return false;
+        }
+        patterns.push_back(makePattern(line.substr(0, tab)));
+        patterns.back().r = unescape(line.substr(tab+1), false, true, !use_regex);
+    }
+    return true;
+}
+
+// adds offset to every backreference of an ECMAScript pattern, for when its groups are
+// numbered after offset other groups in the combined search
+//
+// a backslash followed by digits, not starting with 0, is a backreference outside of a [character class]
+std::string shiftBackreferences(const std::string & pattern, std::size_t offset) {
+    std::string shifted;
+    bool in_class = false;
+    for (std::size_t i = 0, n = pattern.size(); i < n; i++) {
+        char c = pattern[i];
+        if (c == '\\' && i + 1 < n) {
+            char next = pattern[i+1];
+            if (!in_class && next >= '1' && next <= '9') {
+                std::size_t number = 0;
+                i++;
+                for (; i < n && pattern[i] >= '0' && pattern[i] <= '9'; i++) {
+                    number = number * 10 + (pattern[i] - '0');
+                }
+                i--;
+                shifted += '\\';
+                shifted += std::to_string(number + offset);
+                continue;
+            }
+            shifted += c;
+            shifted += next;
+            i++;
+            continue;
+        }
+        if (c == '[') in_class = true;
+        else if (c == ']') in_class = false;
+        shifted += c;
+    }
+    return shifted;
+}
+
+// combines all patterns into a single regex so every file is scanned once, no matter how many patterns there are
+//
+// each pattern is wrapped in a capture group that tells which pattern matched, and
+// its backreferences and its replacement are moved to the group numbers it ends up
+// with, a lone pattern is used as it is
+//
+// when several patterns match at the same position the leftmost alternative wins, literal
+// patterns are therefore ordered longest first, so the longest match wins (leftmost-longest),
+// ties and --regex patterns keep the order they were given in
+bool buildSearch() {
+    auto & patterns = search_info.patterns;
+    std::vector<std::size_t> order(patterns.size());
+    for (std::size_t i = 0; i < order.size(); i++) order[i] = i;
+    if (!use_regex) {
+        std::stable_sort(order.begin(), order.end(), [&](std::size_t a, std::size_t b) {
+            return patterns[a].length > patterns[b].length;
+        });
+    }
+
+    search_info.search.clear();
+    // a lone pattern is searched as it is, its match is group 0
+    if (patterns.size() == 1) {
+        auto & p = patterns[0];
+        if (use_regex) {
+            try {
+                std::regex(p.search, std::regex::ECMAScript);
+            } catch (std::regex_error & e) {
+                std::cout << "invalid regular expression: " << escape(p.search) << ": " << e.what() << std::endl;
+                return false;
+            }
+        }
+        search_info.search = p.search;
+        p.group = 0;
+        p.replacement = ReplacementTemplate(p.r, 0);
+        return true;
+    }
+
+    // every pattern is wrapped in a group of its own, which moves its groups and so its
+    // backreferences and the $n of its replacement behind the groups of the patterns before
+    std::size_t group = 1;
+    for (auto i : order) {
+        auto & p = patterns[i];
+        if (search_info.search.size() != 0) {
+            search_info.search += "|";
+        }
+        p.group = group++;
+        if (use_regex) {
+            try {
+                group += std::regex(p.search, std::regex::ECMAScript).mark_count();
+            } catch (std::regex_error & e) {
+                std::cout << "invalid regular expression: " << escape(p.search) << ": " << e.what() << std::endl;
+                return false;
+            }
+            search_info.search += "(" + shiftBackreferences(p.search, p.group) + ")";
+        } else {
+            search_info.search += "(" + p.search + ")";
+        }
+        p.replacement = ReplacementTemplate(p.r, p.group);
+    }
+    return true;
+}
+
+// creates the --binary-results file, once the search is known to go ahead
+bool openResults() {
+    if (binary_results_path == nullptr) return true;
+    match_log = new MatchLog(binary_results_path);
+    if (!match_log->is_open()) {
+        std::cout << "failed to create --binary-results file: " << binary_results_path << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// completes the --binary-results file, every scan must have finished
+bool finishResults() {
+    if (match_log == nullptr) return true;
+    bool ok = match_log->finish();
+    if (!ok) {
+        std::cout << "failed to write --binary-results file: " << binary_results_path << std::endl;
+    }
+    delete match_log;
+    match_log = nullptr;
+    return ok;
+}
+
+void printSearchInfo() {
+    auto & patterns = search_info.patterns;
+    bool shared = true;
+    for (auto & p : patterns) {
+        if (p.r != patterns[0].r) shared = false;
+    }
+    for (auto & p : patterns) {
+        std::cout << "searching for:        " << escape(p.search) << std::endl;
+        if (!shared && p.r.size() != 0) {
+            std::cout << "  replacing with:     " << escape(p.r) << std::endl;
+        }
+    }
+    if (shared && patterns[0].r.size() != 0) {
+        std::cout << "replacing with:       " << escape(patterns[0].r) << std::endl;
+    }
+}
 
 void help() {
     puts("[1] FindReplace -d/--dir/--dir/-f/--file -s search_items [-r replacement]");
@@ -896,10 +2525,64 @@ void help() {
     puts("--dry-run          no changes will be made during replacement");
     puts("--no-detach        temporary files that are created during a dry run will not be deleted");
     puts("--print-all        print non-matches as well as matches");
+    puts("                     when stdout is a file or a pipe, large non-matches are copied to it by the kernel");
     puts("--silent           dont print any matches from search");
     puts("-n                 print file lines as if 'grep -n'");
     puts("-i                 ignore case, '-s abc' can match both 'abc' and 'ABC' and 'aBc'");
     puts("--no-mmap          uses std::ifstream + ifstream_iterator (SLOW) instead of the mmap (windows/unix) api wrapper");
+    puts("--in-place         if every replacement has the same length as its match, patch the matches directly into the file");
+    puts("                     instead of rewriting it, this is not atomic, requires the mmap api");
+    puts("--regex            search items are ECMAScript regular expressions instead of literal text,");
+    puts("                     the replacement may refer to capture groups with $1 .. $99, $& is the whole match, $$ is a '$'");
+    puts("--dedupe-content   when searching, skip files with the same contents as a file searched before,");
+    puts("                     hard links and paths reached twice, through symbolic links or overlapping");
+    puts("                     directories, are always only searched and replaced once");
+    puts("--binary=skip|text|report");
+    puts("                   what to do with files whose first 8 KiB contain a NUL byte or more than one control");
+    puts("                     character other than whitespace in ten bytes, text in any encoding that extends ASCII");
+    puts("                     and UTF-16 starting with a byte order mark is never binary, skip them (the default),");
+    puts("                     search and replace them like text, or only report whether they match without printing");
+    puts("                     or replacing the matches, files named with -f or as dir/file and stdin are never");
+    puts("                     skipped, they are searched like text");
+    puts("-j, --include, --exclude, --binary, --sort-files, --binary-results and --max-match-length");
+    puts("                   also take their argument after '=', as in --binary=text");
+    puts("--sort-files inode|extent");
+    puts("                   scan the files found in directories in batches of 4096, each ordered by inode number");
+    puts("                     or by the position of the file on disk, so spinning or network disks read them");
+    puts("                     in one sweep instead of seeking, extent needs Linux and a file system with FIEMAP");
+    puts("-j N               scan N files at a time and split large files into segments searched by up to N threads,");
+    puts("                     defaults to the number of cores, -j 1 scans everything in order on a single thread");
+    puts("--largest-first    with -j greater than 1, scan the largest files found so far first, so a large file found");
+    puts("                     late in the walk does not finish long after the rest, scanners without a file of their");
+    puts("                     own help with the segments of a large one, implies --unordered since holding the output");
+    puts("                     in walk order would hold the walk back to the files just before the output");
+    puts("--unordered        with -j greater than 1, print the output of each file as soon as it is scanned and walk");
+    puts("                     directories on N threads, by default the output is in the same order as with -j 1");
+    puts("                     and files scanned early are held back until the files found before them are printed");
+    puts("--to-stdout        write the replaced contents of stdin or of every file to stdout instead of replacing them,");
+    puts("                     one file after another, files are left unchanged and everything else is printed to stderr,");
+    puts("                     binary files are written unchanged, stdin is replaced as it arrives when it can also be searched so");
+    puts("--json             print every match to stdout as a JSON object on a line of its own, with the fields path,");
+    puts("                     offset (in bytes), length, line, column (in bytes, both counted from 1), pattern (the");
+    puts("                     index of the search item that matched), replacement (when replacing) and match, a path,");
+    puts("                     replacement or match that is not valid UTF-8 is an object {\"bytes\":\"...\"} with its bytes");
+    puts("                     in base64 instead of a string, everything else is printed to stderr");
+    puts("--binary-results FILE");
+    puts("                   also write every match to FILE in a compact binary format, the path, offset, length and");
+    puts("                     pattern of each in fixed width columns that can be used from a mapping of FILE without");
+    puts("                     parsing, see include/match_log.h, FindReplaceResults FILE prints or counts them");
+    puts("--stats            with -j greater than 1, print how full the queues between the walk, open, scan and print stages ran");
+    puts("--no-ignore        search everything below a directory, by default entries ignored by a .gitignore or .ignore");
+    puts("                     file in the directory being searched or below it are skipped, as are .git directories");
+    puts("--include GLOB     only search files matching GLOB, may be given more than once");
+    puts("--exclude GLOB     skip files and directories matching GLOB, may be given more than once");
+    puts("                     a GLOB without a '/' matches names, one with a '/' paths relative to the directory being searched,");
+    puts("                     one ending in '/' only directories, '*' '?' '[a-z]' and '**' work as in .gitignore");
+    puts("--max-match-length LENGTH");
+    puts("                   no --regex item matches more than LENGTH bytes, lets large files be searched in parallel and stdin as it arrives");
+    puts("--max-match-length line");
+    puts("                   no --regex item matches across a newline, lets large files be searched in parallel and stdin as it arrives,");
+    puts("                     a line of stdin longer than 64 MiB is then passed on without being searched");
     puts("");
     puts("no arguments       this help text");
     puts("-h, --help         this help text");
@@ -910,6 +2593,8 @@ void help() {
     puts("--stdin            REQUIRED: use stdin as file to search");
     puts("  FindReplace --stdin f  #  marks f as the item to search for");
     puts("  FindReplace f --stdin  #  invalid");
+    puts("the other options, including those taking an argument such as -j and --include,");
+    puts("  may be given before, between or after dir/file, search_item and replacement");
     puts("");
     puts("");
     puts("[1] mode:");
@@ -921,14 +2606,23 @@ void help() {
     puts("  --directory");
     puts("  --search");
     puts("  --replace");
+    puts("  --map");
     puts("-f --stdin         REQUIRED: use stdin as file to search");
     puts("-f FILE            REQUIRED: use FILE as file to search");
     puts("-d DIR             REQUIRED: use DIR as directory to search");
     puts("-s search_items    REQUIRED: the items to search for");
+    puts("--map FILE         OPTIONAL: replace items using FILE, one 'search<TAB>replacement' pair per line,");
+    puts("                     both sides are escaped like command line arguments, lines starting with '#' are ignored");
     puts("-r replacement     OPTIONAL: the item to replace with");
     puts("      |");
-    puts("      | -r/--replace can be specified multiple times, but only the last one will take effect");
+    puts("      | -r/--replace applies to the -s items given since the previous -r/--replace");
+    puts("      | '-s a -r x -s b -r y' replaces 'a' with 'x' and 'b' with 'y' in a single pass");
+    puts("      | '-s a b -r x' replaces both 'a' and 'b' with 'x'");
     puts("      | '-r a -r b -r c' will act as if only given '-r c'");
+    puts("      | -s items given after the last -r/--replace use the last -r/--replace");
+    puts("      |");
+    puts("      | if several items match at the same position, the longest one is replaced");
+    puts("      | with --regex, the item given first is replaced");
     puts("      |");
     puts("      |  CONSTRAINTS:");
     puts("      |");
@@ -970,6 +2664,9 @@ void help() {
     puts("FindReplace -f --stdin -s a \"foo \\n bar\" go -r Alex");
     puts("   searches 'stdin' for the items 'a', 'foo \\n bar', and 'go', and replaces all of these with 'Alex'");
     puts("");
+    puts("FindReplace -d my_dir -s apple --binary-results apples && FindReplaceResults apples --files");
+    puts("   records every 'apple' in 'my_dir' in the file 'apples', then prints how many each file has");
+    puts("");
     puts("printf \"fo\\$oba1\\bg2\\\\\\br1\\n2\\n\" > /tmp/foo && FindReplace -- -f /tmp/foo -s \"\\$o\" \"1\\b\" \"2\\\\\\\\\\\\\\b\" \"1\\n2\" -r \"__RACER_X__\"");
     puts("   self explanatory by now, shell $variables are escaped");
     exit(1);
@@ -987,6 +2684,34 @@ std::vector<std::pair<int, std::pair<const char*, bool>>> find_item(int argc, co
     return results;
 }
 
+// flags with an argument that do not choose what is searched, both forms take them,
+// as --flag value or --flag=value
+const std::vector<std::pair<const char*, bool>> value_options = {{"--max-match-length", true}, {"-j", true}, {"--include", true}, {"--exclude", true}, {"--binary", true}, {"--sort-files", true}, {"--binary-results", true}};
+
+// splits every --flag=value of value_options into --flag and value, arguments holds the strings
+std::vector<const char*> splitValueOptions(int argc, const char** argv, std::vector<std::string> & arguments) {
+    for (int i = 0; i < argc; i++) {
+        const char * equals = strchr(argv[i], '=');
+        bool split = false;
+        if (i != 0 && equals != nullptr) {
+            for (auto & option : value_options) {
+                if (strncmp(argv[i], option.first, equals - argv[i]) == 0 && strlen(option.first) == std::size_t(equals - argv[i])) {
+                    split = true;
+                }
+            }
+        }
+        if (split) {
+            arguments.emplace_back(argv[i], equals);
+            arguments.emplace_back(equals + 1);
+        } else {
+            arguments.emplace_back(argv[i]);
+        }
+    }
+    std::vector<const char*> split_argv;
+    for (auto & argument : arguments) split_argv.push_back(argument.c_str());
+    return split_argv;
+}
+
 int
 #ifdef _WIN32
 wmain(int argc, const wchar_t *argv[])
@@ -999,6 +2724,11 @@ main(int argc, const char*argv[])
     // argc 3 == prog arg1 arg2
     // argc 4 == prog arg1 arg3 arg3
 
+    std::vector<std::string> arguments;
+    auto split_argv = splitValueOptions(argc, argv, arguments);
+    argc = split_argv.size();
+    argv = split_argv.data();
+
     for (int i = 0; i < argc; i++) {
         if (strcmp(argv[i], "--dry-run") == 0) {
             dry_run = true;
@@ -1014,64 +2744,178 @@ main(int argc, const char*argv[])
             silent = true;
         } else if (strcmp(argv[i], "--no-mmap") == 0) {
             use_mmap = false;
+        } else if (strcmp(argv[i], "--in-place") == 0) {
+            in_place = true;
+        } else if (strcmp(argv[i], "--regex") == 0) {
+            use_regex = true;
+        } else if (strcmp(argv[i], "--stats") == 0) {
+            print_stats = true;
+        } else if (strcmp(argv[i], "--dedupe-content") == 0) {
+            dedupe_content = true;
+        } else if (strcmp(argv[i], "--largest-first") == 0) {
+            // holding the output in walk order would also hold back the walk, see ScanPipeline
+            largest_first = true;
+            unordered = true;
+        } else if (strcmp(argv[i], "--unordered") == 0) {
+            unordered = true;
+        } else if (strcmp(argv[i], "--to-stdout") == 0) {
+            to_stdout = true;
+        } else if (strcmp(argv[i], "--json") == 0) {
+            json_output = true;
+        } else if (strcmp(argv[i], "--no-ignore") == 0) {
+            path_filter.use_ignore_files(false);
+        } else if ((strcmp(argv[i], "--include") == 0 || strcmp(argv[i], "--exclude") == 0)) {
+            if (i + 1 == argc) {
+                std::cout << argv[i] << " requires a glob" << std::endl;
+                return 1;
+            }
+            if (strcmp(argv[i], "--include") == 0) {
+                path_filter.include(argv[i+1]);
+            } else {
+                path_filter.exclude(argv[i+1]);
+            }
+        } else if (strcmp(argv[i], "--binary") == 0) {
+            const char * value = i + 1 == argc ? "" : argv[i+1];
+            if (strcmp(value, "skip") == 0) {
+                binary_files = BINARY_SKIP;
+            } else if (strcmp(value, "text") == 0) {
+                binary_files = BINARY_TEXT;
+            } else if (strcmp(value, "report") == 0) {
+                binary_files = BINARY_REPORT;
+            } else {
+                std::cout << "--binary must be one of skip, text, report" << std::endl;
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--binary-results") == 0) {
+            if (i + 1 == argc) {
+                std::cout << "--binary-results requires a file" << std::endl;
+                return 1;
+            }
+            binary_results_path = argv[i+1];
+        } else if (strcmp(argv[i], "--sort-files") == 0) {
+            const char * value = i + 1 == argc ? "" : argv[i+1];
+            if (strcmp(value, "inode") == 0) {
+                sort_files = SORT_INODE;
+            } else if (strcmp(value, "extent") == 0) {
+                sort_files = SORT_EXTENT;
+            } else {
+                std::cout << "--sort-files must be one of inode, extent" << std::endl;
+                return 1;
+            }
+        } else if (strcmp(argv[i], "-j") == 0) {
+            if (i + 1 == argc) {
+                std::cout << "-j requires a number of jobs" << std::endl;
+                return 1;
+            }
+            char * value_end;
+            unsigned long value = strtoul(argv[i+1], &value_end, 10);
+            if (*argv[i+1] == '\0' || *value_end != '\0' || value == 0) {
+                std::cout << "invalid number of jobs: " << argv[i+1] << std::endl;
+                return 1;
+            }
+            jobs = value;
+        } else if (strcmp(argv[i], "--max-match-length") == 0) {
+            if (i + 1 == argc) {
+                std::cout << "--max-match-length requires a length or 'line'" << std::endl;
+                return 1;
+            }
+            const char * value = argv[i+1];
+            if (strcmp(value, "line") == 0) {
+                match_within_lines = true;
+            } else {
+                char * value_end;
+                max_match_length = strtoull(value, &value_end, 10);
+                if (*value == '\0' || *value_end != '\0' || max_match_length == 0) {
+                    std::cout << "invalid --max-match-length: " << value << std::endl;
+                    return 1;
+                }
+            }
         }
     }
 
-    auto items_ = find_item(argc, argv, 1, {{"--dry-run", false}, {"--no-detach", false}, {"--print-all", false}, {"-n", false}, {"-i", false}, {"--silent", false}, {"--no-mmap", false}});
-    auto items = find_item(argc, argv, 1, {{"-h", true}, {"--help", true}, {"-f", true}, {"--file", true}, {"-d", true}, {"--dir", true}, {"--directory", true}, {"-s", true}, {"--search", true}, {"-r", true}, {"--replace", true}});
+    if (to_stdout && json_output) {
+        std::cout << "--json can not be used with --to-stdout, both write to stdout" << std::endl;
+        return 1;
+    }
+
+    if (to_stdout) {
+        // stdout only carries the replaced contents, everything else printed goes to stderr
+        stdout_fd = dup(1);
+        dup2(2, 1);
+    }
+
+    if (json_output) {
+        // stdout only carries the records, written by records(), out() already goes to stderr
+        std::cout.rdbuf(std::cerr.rdbuf());
+    }
+
+    auto items_ = find_item(argc, argv, 1, {{"--dry-run", false}, {"--no-detach", false}, {"--print-all", false}, {"-n", false}, {"-i", false}, {"--silent", false}, {"--no-mmap", false}, {"--in-place", false}, {"--regex", false}, {"--stats", false}, {"--no-ignore", false}, {"--dedupe-content", false}, {"--largest-first", false}, {"--unordered", false}, {"--to-stdout", false}, {"--json", false}});
+    auto options = find_item(argc, argv, 1, value_options);
+    auto items = find_item(argc, argv, 1, {{"-h", true}, {"--help", true}, {"-f", true}, {"--file", true}, {"-d", true}, {"--dir", true}, {"--directory", true}, {"-s", true}, {"--search", true}, {"-r", true}, {"--replace", true}, {"--map", true}});
     if (items.size() == 0) {
 
-        if (argc == 1 || argc == 2) {
+        // if we have no flags given, default to DIR, SEARCH, REPLACE, given around the other flags
+        std::vector<const char *> positional;
+        for (int i = 1; i < argc; i++) {
+            bool flag = false;
+            for (auto & p : items_) {
+                if (p.first == i) flag = true;
+            }
+            for (auto & p : options) {
+                if (p.first == i || p.first + 1 == i) flag = true;
+            }
+            if (!flag) positional.push_back(argv[i]);
+        }
+
+        if (positional.size() < 2) {
             help();
         }
-        // if we have no flags given, default to DIR, SEARCH, REPLACE
-        // we know argc == 3 or more
-        // this means   prog arg1 arg2 ...
+        if (positional.size() > 3) {
+            std::cout << "unknown argument: " << positional[3] << std::endl;
+            return 1;
+        }
 
         {
-            search_info.search = unescape(argv[2], true, false);
-
-            if (search_info.search.length() == 0) {
+            if (strlen(positional[1]) == 0) {
                 std::cout << "skipping zero length search" << std::endl;
                 return 0;
             }
+            search_info.patterns.push_back(makePattern(positional[1]));
+        }
+        if (positional.size() == 3) {
+            search_info.patterns.back().r = unescape(positional[2], false, true, !use_regex);
+        }
+        search_info.searching = positional.size() == 2;
+
+        if (to_stdout && search_info.searching) {
+            std::cout << "--to-stdout requires a replacement" << std::endl;
+            return 1;
         }
-        if (argc == 4) {
-            search_info.r = unescape(argv[3], false, true);
+
+        if (!buildSearch() || !openResults()) {
+            return 1;
         }
-        auto dir = argv[1];
+        auto dir = positional[0];
         if (strcmp(dir, "--stdin") == 0) {
 
             std::cout << "using stdin as search area" << std::endl;
-            std::cout << "searching for:        " << escape(search_info.search) << std::endl;
-            if (search_info.r.size() != 0) {
-                std::cout << "replacing with:       " << escape(search_info.r) << std::endl;
-            }
+            printSearchInfo();
 
             REOPEN_STDIN_AS_BINARY();
 
-            TempFile tmp_file("FindReplace__stdin_");
-
-            std::cout << "created temporary file: " << tmp_file.get_path() << std::endl;
-
-            std::ofstream std__in__file (tmp_file.get_path(), std::ios::binary | std::ios::out);
-
-            toOutStream(&std::cin, &std__in__file, -1, 4096);
-
-            std__in__file.flush();
-            std__in__file.close();
-
-            invokeMMAP(tmp_file.get_path().c_str()) ? 0 : 1;
+            invokeStdin();
+            flushOutput();
         } else {
             std::cout << "directory/file to search:  " << dir << std::endl;
-            std::cout << "searching for:        " << escape(search_info.search) << std::endl;
-            if (search_info.r.size() != 0) {
-                std::cout << "replacing with:       " << escape(search_info.r) << std::endl;
-            }
+            printSearchInfo();
+            named_files.insert(dir);
+            startScans();
             invoke_dir(dir);
+            waitForScans();
         }
     } else {
         // we have flags
+        for (auto & extra : options) items.push_back(extra);
         for (auto & extra : items_) items.push_back(extra);
         for (auto & p : items) {
             if (p.second.first != nullptr) {
@@ -1124,9 +2968,16 @@ main(int argc, const char*argv[])
             return 1;
         }
 
-        // collect search
+        // collect search items and their replacements
+        //
+        // a -r applies to the -s items given since the previous -r, a -r that directly
+        // follows another -r replaces it, and items given after the last -r use the last -r
         {
-            bool first = true;
+            const char * rep = nullptr;
+            std::size_t group_start = 0;
+            std::size_t unpaired = 0;
+            const char * map_file = nullptr;
+            auto & patterns = search_info.patterns;
             for (auto & p : items) {
                 if (p.second.first != nullptr) {
                     if (strcmp(p.second.first, "-s") == 0 || strcmp(p.second.first, "--search") == 0) {
@@ -1142,53 +2993,77 @@ main(int argc, const char*argv[])
                                 }
                             }
                             if (end_search) break;
-                            if (first) {
-                                first = false;
-                            } else {
-                                search_info.search += "|";
+                            if (strlen(argv[i]) == 0) {
+                                std::cout << "skipping zero length search item" << std::endl;
+                                continue;
                             }
-                            search_info.search += unescape(argv[i], true, false);
+                            patterns.push_back(makePattern(argv[i]));
+                        }
+                    } else if (strcmp(p.second.first, "-r") == 0 || strcmp(p.second.first, "--replace") == 0) {
+                        rep = argv[p.first+1];
+                        if (unpaired != patterns.size()) {
+                            group_start = unpaired;
                         }
+                        for (std::size_t i = group_start; i < patterns.size(); i++) {
+                            patterns[i].r = unescape(rep, false, true, !use_regex);
+                        }
+                        unpaired = patterns.size();
+                    } else if (strcmp(p.second.first, "--map") == 0) {
+                        map_file = argv[p.first+1];
                     }
                 }
             }
 
-            if (search_info.search.length() == 0) {
+            if (rep) {
+                for (std::size_t i = unpaired; i < patterns.size(); i++) {
+                    patterns[i].r = unescape(rep, false, true, !use_regex);
+                }
+            } else if (map_file && patterns.size() != 0) {
+                std::cout << "search items given with --map must have a replacement, use -r" << std::endl;
+                return 1;
+            }
+
+            // the mapping file pairs each search item with its own replacement
+            if (map_file && !readMappingFile(map_file, patterns)) {
+                return 1;
+            }
+
+            if (patterns.size() == 0) {
                 std::cout << "skipping zero length search" << std::endl;
                 return 0;
             }
-        }
 
-        // collect replacement
-        const char * rep = nullptr;
-        for (auto & p : items) {
-            if (p.second.first != nullptr) {
-                if (strcmp(p.second.first, "-r") == 0 || strcmp(p.second.first, "--replace") == 0) {
-                    rep = argv[p.first+1];
-                }
+            search_info.searching = rep == nullptr && map_file == nullptr;
+
+            if (to_stdout && search_info.searching) {
+                std::cout << "--to-stdout requires a replacement, -r or --map" << std::endl;
+                return 1;
             }
-        }
 
-        if (rep) {
-            search_info.r = unescape(rep, false, true);
-            search_info.searching = false;
-        } else {
-            search_info.searching = true;
+            if (!buildSearch()) {
+                return 1;
+            }
         }
 
-        std::cout << "searching for:        " << escape(search_info.search) << std::endl;
-        if (search_info.r.size() != 0) {
-            std::cout << "replacing with:       " << escape(search_info.r) << std::endl;
+        if (!openResults()) {
+            return 1;
         }
 
+        printSearchInfo();
+
+        for (auto f : files) {
+            named_files.insert(f);
+        }
+        startScans();
         for (auto f : files) {
-            std::cout << "file to search:  " << f << std::endl;
+            report("file to search:  ", f);
             invoke_dir(f);
         }
         for (auto d : directories) {
-            std::cout << "directory to search:  " << d << std::endl;
+            report("directory to search:  ", d);
             invoke_dir(d);
         }
+        waitForScans();
 
         if (is_stdin) {
 
@@ -1196,19 +3071,9 @@ main(int argc, const char*argv[])
 
             REOPEN_STDIN_AS_BINARY();
 
-            TempFile tmp_file("FindReplace__stdin_");
-
-            std::cout << "created temporary file: " << tmp_file.get_path() << std::endl;
-
-            std::ofstream std__in__file (tmp_file.get_path(), std::ios::binary | std::ios::out);
-
-            toOutStream(&std::cin, &std__in__file, -1, 4096);
-
-            std__in__file.flush();
-            std__in__file.close();
-
-            invokeMMAP(tmp_file.get_path().c_str());
+            invokeStdin();
+            flushOutput();
         }
     }
-    return 0;
+    return finishResults() ? 0 : 1;
 }
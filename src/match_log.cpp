@@ -0,0 +1,268 @@
+#include <match_log.h>
+
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+
+#include <fcntl.h>
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+#ifndef O_BINARY
+#define O_BINARY 0
+#endif
+
+static const char MAGIC[8] = {'F', 'R', 'M', 'A', 'T', 'C', 'H', '\0'};
+static const std::uint32_t VERSION = 1;
+static const std::uint32_t BYTE_ORDER_MARK = 0x01020304;
+static const std::size_t HEADER_SIZE = 16;
+static const std::size_t FOOTER_SIZE = 48;
+
+static std::atomic<std::uint64_t> next_id {1};
+
+MatchLog::MatchLog(const char * path) : id(next_id++) {
+    fd = ::open(path, O_WRONLY | O_CREAT | O_TRUNC | O_BINARY, 0666);
+    if (fd == -1) return;
+    char header[HEADER_SIZE];
+    std::memcpy(header, MAGIC, 8);
+    std::memcpy(header + 8, &VERSION, 4);
+    std::memcpy(header + 12, &BYTE_ORDER_MARK, 4);
+    write(header, sizeof(header));
+}
+
+MatchLog::~MatchLog() {
+    if (fd != -1) ::close(fd);
+}
+
+bool MatchLog::is_open() const {
+    return fd != -1;
+}
+
+bool MatchLog::write(const void * data, std::size_t length) {
+    auto p = static_cast<const char *>(data);
+    while (length != 0 && !failed) {
+#ifdef _WIN32
+        auto w = _write(fd, p, static_cast<unsigned int>(length));
+#else
+        auto w = ::write(fd, p, length);
+#endif
+        if (w == -1) {
+            if (errno == EINTR) continue;
+            failed = true;
+            break;
+        }
+        p += w;
+        length -= w;
+        position += w;
+    }
+    return !failed;
+}
+
+// called with the mutex held
+void MatchLog::write_block(Block & block) {
+    std::size_t count = block.offset.size();
+    if (count == 0) return;
+    block_table.emplace_back(position, count);
+    write(block.offset.data(), count * sizeof(std::uint64_t));
+    write(block.length.data(), count * sizeof(std::uint64_t));
+    write(block.file.data(), count * sizeof(std::uint32_t));
+    write(block.pattern.data(), count * sizeof(std::uint32_t));
+    matches += count;
+    block.offset.clear();
+    block.length.clear();
+    block.file.clear();
+    block.pattern.clear();
+}
+
+MatchLog::Block & MatchLog::thread_block() {
+    thread_local Block * block = nullptr;
+    thread_local std::uint64_t owner = 0;
+    if (owner != id) {
+        auto created = std::make_unique<Block>();
+        created->offset.reserve(BLOCK_CAPACITY);
+        created->length.reserve(BLOCK_CAPACITY);
+        created->file.reserve(BLOCK_CAPACITY);
+        created->pattern.reserve(BLOCK_CAPACITY);
+        std::lock_guard<std::mutex> lock(mutex);
+        block = created.get();
+        owner = id;
+        blocks.push_back(std::move(created));
+    }
+    return *block;
+}
+
+std::uint32_t MatchLog::add_file(const std::string & path) {
+    std::lock_guard<std::mutex> lock(mutex);
+    paths.push_back(path);
+    return static_cast<std::uint32_t>(paths.size() - 1);
+}
+
+void MatchLog::add(std::uint32_t file, std::uint64_t offset, std::uint64_t length, std::uint32_t pattern) {
+    Block & block = thread_block();
+    block.offset.push_back(offset);
+    block.length.push_back(length);
+    block.file.push_back(file);
+    block.pattern.push_back(pattern);
+    if (block.offset.size() == BLOCK_CAPACITY) {
+        std::lock_guard<std::mutex> lock(mutex);
+        write_block(block);
+    }
+}
+
+bool MatchLog::finish() {
+    if (fd == -1) return false;
+    std::lock_guard<std::mutex> lock(mutex);
+    for (auto & block : blocks) {
+        write_block(*block);
+    }
+
+    std::uint64_t block_table_position = position;
+    for (auto & entry : block_table) {
+        std::uint64_t fields[2] = {entry.first, entry.second};
+        write(fields, sizeof(fields));
+    }
+
+    std::uint64_t path_table_position = position;
+    std::uint64_t end = 0;
+    for (auto & path : paths) {
+        end += path.size();
+        write(&end, sizeof(end));
+    }
+    for (auto & path : paths) {
+        write(path.data(), path.size());
+    }
+    static const char padding[8] = {};
+    write(padding, (8 - position % 8) % 8);
+
+    std::uint64_t footer[5] = {block_table_position, block_table.size(), path_table_position, paths.size(), matches};
+    write(footer, sizeof(footer));
+    write(MAGIC, sizeof(MAGIC));
+
+    bool ok = !failed && ::close(fd) == 0;
+    fd = -1;
+    return ok;
+}
+
+MatchLogReader::MatchLogReader(const char * path) : map(path, 'r') {
+    if (!map.is_open()) {
+        fail("failed to open file");
+        return;
+    }
+    size = map.length();
+    if (size < HEADER_SIZE + FOOTER_SIZE) {
+        fail("file too short");
+        return;
+    }
+    whole = map.obtain_map(0, size);
+    if (whole.get() == nullptr) {
+        fail("failed to map file");
+        return;
+    }
+    data = static_cast<const char *>(whole->get());
+
+    std::uint32_t version, byte_order;
+    std::memcpy(&version, data + 8, 4);
+    std::memcpy(&byte_order, data + 12, 4);
+    if (std::memcmp(data, MAGIC, 8) != 0 || std::memcmp(data + size - 8, MAGIC, 8) != 0) {
+        fail("not a --binary-results file");
+        return;
+    }
+    if (byte_order != BYTE_ORDER_MARK) {
+        fail("written on a machine with a different byte order");
+        return;
+    }
+    if (version != VERSION) {
+        fail("unknown version");
+        return;
+    }
+
+    // the mapping is page aligned and everything in the file is aligned to its size
+    auto footer = reinterpret_cast<const std::uint64_t *>(data + size - FOOTER_SIZE);
+    std::uint64_t block_table_position = footer[0];
+    blocks = footer[1];
+    std::uint64_t path_table_position = footer[2];
+    paths = footer[3];
+    matches = footer[4];
+
+    std::uint64_t limit = size - FOOTER_SIZE;
+    if (block_table_position % 8 != 0 || block_table_position > limit || blocks > (limit - block_table_position) / 16) {
+        fail("broken block table");
+        return;
+    }
+    block_table = reinterpret_cast<const std::uint64_t *>(data + block_table_position);
+    std::uint64_t counted = 0;
+    for (std::uint64_t i = 0; i < blocks; i++) {
+        std::uint64_t position = block_table[2*i];
+        std::uint64_t count = block_table[2*i+1];
+        if (position % 8 != 0 || position > block_table_position || count > (block_table_position - position) / 24) {
+            fail("broken block table");
+            return;
+        }
+        counted += count;
+    }
+    if (counted != matches) {
+        fail("broken block table");
+        return;
+    }
+
+    if (path_table_position % 8 != 0 || path_table_position > limit || paths > (limit - path_table_position) / 8) {
+        fail("broken path table");
+        return;
+    }
+    path_ends = reinterpret_cast<const std::uint64_t *>(data + path_table_position);
+    path_data = data + path_table_position + paths * 8;
+    std::uint64_t previous = 0;
+    for (std::uint64_t i = 0; i < paths; i++) {
+        if (path_ends[i] < previous || path_ends[i] > static_cast<std::uint64_t>(data + limit - path_data)) {
+            fail("broken path table");
+            return;
+        }
+        previous = path_ends[i];
+    }
+}
+
+void MatchLogReader::fail(const char * message) {
+    error = message;
+    data = nullptr;
+}
+
+bool MatchLogReader::is_open() const {
+    return data != nullptr;
+}
+
+const std::string & MatchLogReader::get_error() const {
+    return error;
+}
+
+std::uint64_t MatchLogReader::match_count() const {
+    return matches;
+}
+
+std::size_t MatchLogReader::block_count() const {
+    return blocks;
+}
+
+MatchLogReader::Block MatchLogReader::block(std::size_t index) const {
+    std::uint64_t position = block_table[2*index];
+    std::size_t count = block_table[2*index+1];
+    const char * p = data + position;
+    Block b;
+    b.count = count;
+    b.offset = reinterpret_cast<const std::uint64_t *>(p);
+    b.length = reinterpret_cast<const std::uint64_t *>(p + count * 8);
+    b.file = reinterpret_cast<const std::uint32_t *>(p + count * 16);
+    b.pattern = reinterpret_cast<const std::uint32_t *>(p + count * 20);
+    return b;
+}
+
+std::size_t MatchLogReader::path_count() const {
+    return paths;
+}
+
+std::string_view MatchLogReader::path(std::uint32_t file) const {
+    std::uint64_t begin = file == 0 ? 0 : path_ends[file - 1];
+    return std::string_view(path_data + begin, path_ends[file] - begin);
+}
@@ -60,6 +60,7 @@ MMapIterator::~MMapIterator() {}
 
 const char * MMapIterator::get_api() const { return api; }
 size_t MMapIterator::get_page_size() const { return page_size; }
+size_t MMapIterator::get_index() const { return index; }
 bool MMapIterator::is_open() const { return map->is_open(); }
 size_t MMapIterator::length() const { return map->length(); }
 
@@ -173,3 +174,15 @@ MMapIterator::reference MMapIterator::operator*() const {
 MMapIterator::pointer MMapIterator::operator->() const {
     return &this->operator*();
 }
+
+const char * MMapIterator::page_data(size_t & length) const {
+    // maps the page holding index if it is not mapped yet
+    const char * data = &this->operator*();
+    length = current_page->offset() + current_page->length() - index;
+    return data;
+}
+
+MMapIterator & MMapIterator::operator+=(difference_type n) {
+    index += n;
+    return *this;
+}
@@ -0,0 +1,116 @@
+#include <output_sink.h>
+
+#include <cerrno>
+#include <cstdio>
+#include <iostream>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+#ifdef __linux__
+#include <sys/sendfile.h>
+#endif
+
+// the most each sendfile() call moves at a time
+static const std::size_t SEND_CHUNK = 1024*1024*1024;
+
+OutputSink::OutputSink(int fd) : fd(fd) {}
+
+bool OutputSink::write(const char * data, std::size_t length) {
+    std::lock_guard<std::mutex> lock(mutex);
+    return write_locked(data, length);
+}
+
+bool OutputSink::write_locked(const char * data, std::size_t length) {
+    std::cout.flush();
+    std::fflush(stdout);
+    while (length != 0) {
+#ifdef _WIN32
+        auto w = _write(fd, data, static_cast<unsigned int>(length));
+#else
+        auto w = ::write(fd, data, length);
+#endif
+        if (w == -1) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        data += w;
+        length -= w;
+    }
+    return true;
+}
+
+bool OutputSink::write_file(int in_fd, std::uint64_t offset, std::uint64_t length) {
+#ifdef __linux__
+    std::lock_guard<std::mutex> lock(mutex);
+    std::cout.flush();
+    std::fflush(stdout);
+    bool sent = false;
+    while (length != 0) {
+        off_t position = offset;
+        auto r = sendfile(fd, in_fd, &position, length < SEND_CHUNK ? length : SEND_CHUNK);
+        if (r == -1) {
+            if (errno == EINTR) continue;
+            // a terminal, or an old kernel that only sends to sockets, the caller writes it
+            if (!sent && (errno == EINVAL || errno == ENOSYS || errno == EOPNOTSUPP)) return false;
+            // what was sent can not be taken back, the rest is lost as with a failed write()
+            return true;
+        }
+        // the file shrunk since it was searched
+        if (r == 0) return true;
+        sent = true;
+        offset += r;
+        length -= r;
+    }
+    return true;
+#else
+    (void)in_fd;
+    (void)offset;
+    (void)length;
+    return false;
+#endif
+}
+
+OutputBuffer::OutputBuffer(OutputSink & sink, std::size_t capacity) : sink(sink), capacity(capacity) {
+    buffer.reserve(capacity);
+}
+
+OutputBuffer::~OutputBuffer() {
+    capturing = false;
+    flush();
+}
+
+void OutputBuffer::flush() {
+    if (capturing || buffer.empty()) return;
+    sink.write(buffer.data(), buffer.size());
+    buffer.clear();
+}
+
+bool OutputBuffer::write_file(int in_fd, std::uint64_t offset, std::uint64_t length) {
+    if (capturing) return false;
+    flush();
+    return sink.write_file(in_fd, offset, length);
+}
+
+void OutputBuffer::begin_capture() {
+    flush();
+    capturing = true;
+}
+
+void OutputBuffer::end_capture(std::string & text) {
+    capturing = false;
+    text.swap(buffer);
+    buffer.clear();
+}
+
+void OutputBuffer::stop_capture() {
+    capturing = false;
+    flush();
+}
+
+bool OutputBuffer::is_capturing() const {
+    return capturing;
+}
@@ -0,0 +1,159 @@
+#include <output_writer.h>
+
+#include <cerrno>
+#include <cstring>
+#include <climits>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+#ifndef IOV_MAX
+#define IOV_MAX 1024
+#endif
+
+const std::size_t OutputWriter::copy_threshold = 64*1024;
+
+static const std::size_t scratch_size = 256*1024;
+
+OutputWriter::OutputWriter(int out_fd, int src_fd, const char * src_data, std::int64_t out_offset) : out_fd(out_fd), src_fd(src_fd), src_data(src_data), out_offset(out_offset) {
+    iov.reserve(IOV_MAX);
+    // never resized, iovecs point into it until the next flush
+    scratch.resize(scratch_size);
+}
+
+OutputWriter::~OutputWriter() {
+    flush();
+}
+
+bool OutputWriter::ok() const {
+    return !failed;
+}
+
+std::uint64_t OutputWriter::written() const {
+    return total;
+}
+
+void OutputWriter::push(const char * data, std::size_t length) {
+    if (length == 0) return;
+    if (iov.size() == IOV_MAX) write_iov();
+    iov.push_back({const_cast<char*>(data), length});
+    total += length;
+}
+
+void OutputWriter::copy(std::size_t offset, std::size_t length) {
+    if (failed || length == 0) return;
+    if (kernel_copy && src_fd != -1 && length >= copy_threshold) {
+        if (!write_iov()) return;
+        if (copy_range(offset, length)) {
+            total += length;
+            return;
+        }
+        if (failed) return;
+        // the kernel cannot copy between these files, stop asking
+        kernel_copy = false;
+    }
+    push(src_data + offset, length);
+}
+
+void OutputWriter::write(const char * data, std::size_t length) {
+    if (failed || length == 0) return;
+    if (length > scratch.size() - scratch_used) {
+        if (!flush()) return;
+        if (length > scratch.size()) {
+            // too large to buffer, write it out now
+            push(data, length);
+            write_iov();
+            return;
+        }
+    }
+    char * dest = scratch.data() + scratch_used;
+    std::memcpy(dest, data, length);
+    scratch_used += length;
+    // merge with the previous iovec when it ends right where this one starts
+    if (!iov.empty() && static_cast<char*>(iov.back().iov_base) + iov.back().iov_len == dest) {
+        iov.back().iov_len += length;
+        total += length;
+    } else {
+        push(dest, length);
+    }
+}
+
+void OutputWriter::write_stable(const char * data, std::size_t length) {
+    if (failed) return;
+    push(data, length);
+}
+
+bool OutputWriter::flush() {
+    if (failed) return false;
+    bool r = write_iov();
+    scratch_used = 0;
+    return r;
+}
+
+bool OutputWriter::write_iov() {
+    if (failed) return false;
+    std::size_t i = 0;
+    while (i < iov.size()) {
+#ifdef _WIN32
+        auto w = _write(out_fd, iov[i].iov_base, static_cast<unsigned int>(iov[i].iov_len));
+#else
+        int count = static_cast<int>(iov.size() - i);
+        auto w = out_offset == -1 ? writev(out_fd, &iov[i], count) : pwritev(out_fd, &iov[i], count, out_offset);
+#endif
+        if (w == -1) {
+            if (errno == EINTR) continue;
+            failed = true;
+            return false;
+        }
+        if (out_offset != -1) out_offset += w;
+        // skip fully written iovecs, then adjust a partially written one
+        std::size_t n = w;
+        while (i < iov.size() && n >= iov[i].iov_len) {
+            n -= iov[i].iov_len;
+            i++;
+        }
+        if (n != 0) {
+            iov[i].iov_base = static_cast<char*>(iov[i].iov_base) + n;
+            iov[i].iov_len -= n;
+        }
+    }
+    iov.clear();
+    return true;
+}
+
+bool OutputWriter::copy_range(std::size_t offset, std::size_t length) {
+#if defined(__linux__) && defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 27))
+    loff_t off_in = offset;
+    loff_t off_out = out_offset;
+    std::size_t copied = 0;
+    while (copied < length) {
+        auto r = copy_file_range(src_fd, &off_in, out_fd, out_offset == -1 ? nullptr : &off_out, length - copied, 0);
+        if (r == -1) {
+            if (errno == EINTR) continue;
+            if (errno == EXDEV || errno == EINVAL || errno == ENOSYS || errno == EOPNOTSUPP || errno == EBADF) {
+                if (copied == 0) return false;
+                // finish through user space
+                push(src_data + offset + copied, length - copied);
+                total -= length - copied;
+                if (out_offset != -1) out_offset = off_out;
+                return write_iov();
+            }
+            failed = true;
+            return false;
+        }
+        if (r == 0) {
+            // the source is shorter than its mapping claimed
+            failed = true;
+            return false;
+        }
+        copied += r;
+    }
+    if (out_offset != -1) out_offset = off_out;
+    return true;
+#else
+    return false;
+#endif
+}
@@ -0,0 +1,240 @@
+#include <path_filter.h>
+
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+#include <fcntl.h>
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+// matches the character class starting at p, which points to its '[', and moves p past the class,
+// returns -1 without moving p if the class is not closed, the '[' is then a plain character
+static int match_class(const char *& p, const char * pe, char c) {
+    const char * q = p + 1;
+    bool negate = q != pe && (*q == '!' || *q == '^');
+    if (negate) q++;
+    bool matched = false;
+    bool first = true;
+    while (q != pe && (*q != ']' || first)) {
+        first = false;
+        char lo = *q;
+        if (lo == '\\' && q + 1 != pe) lo = *++q;
+        if (q + 2 < pe && q[1] == '-' && q[2] != ']') {
+            char hi = q[2];
+            if (c >= lo && c <= hi) matched = true;
+            q += 3;
+        } else {
+            if (c == lo) matched = true;
+            q++;
+        }
+    }
+    if (q == pe) return -1;
+    p = q + 1;
+    return matched != negate && c != '/';
+}
+
+static bool glob_match(const char * p, const char * pe, const char * t, const char * te) {
+    while (p != pe) {
+        char c = *p;
+        if (c == '*') {
+            if (p + 1 != pe && p[1] == '*') {
+                const char * rest = p + 2;
+                if (rest != pe && *rest == '/') {
+                    // zero or more whole directories
+                    rest++;
+                    if (glob_match(rest, pe, t, te)) return true;
+                    for (const char * s = t; s != te; s++) {
+                        if (*s == '/' && glob_match(rest, pe, s + 1, te)) return true;
+                    }
+                    return false;
+                }
+                for (const char * s = t; ; s++) {
+                    if (glob_match(rest, pe, s, te)) return true;
+                    if (s == te) return false;
+                }
+            }
+            p++;
+            for (const char * s = t; ; s++) {
+                if (glob_match(p, pe, s, te)) return true;
+                if (s == te || *s == '/') return false;
+            }
+        }
+        if (t == te) return false;
+        if (c == '?') {
+            if (*t == '/') return false;
+        } else if (c == '[') {
+            int r = match_class(p, pe, *t);
+            if (r == 0) return false;
+            if (r == 1) {
+                t++;
+                continue;
+            }
+            if (*t != '[') return false;
+        } else {
+            if (c == '\\' && p + 1 != pe) c = *++p;
+            if (c != *t) return false;
+        }
+        p++;
+        t++;
+    }
+    return t == te;
+}
+
+Glob::Glob(const std::string & pattern) : pattern(pattern) {
+    auto is_plain = [](const std::string & s, std::size_t from) {
+        return s.find_first_of("*?[\\", from) == std::string::npos;
+    };
+    if (is_plain(pattern, 0)) {
+        kind = LITERAL;
+        literal = pattern;
+    } else if (pattern.size() > 1 && pattern[0] == '*' && is_plain(pattern, 1) && pattern.find('/') == std::string::npos) {
+        kind = SUFFIX;
+        literal = pattern.substr(1);
+    } else {
+        kind = GENERIC;
+    }
+}
+
+bool Glob::matches(const char * text, std::size_t length) const {
+    switch (kind) {
+        case LITERAL:
+            return length == literal.size() && memcmp(text, literal.data(), length) == 0;
+        case SUFFIX:
+            return length >= literal.size()
+                && memcmp(text + length - literal.size(), literal.data(), literal.size()) == 0
+                && memchr(text, '/', length - literal.size()) == nullptr;
+        default:
+            return glob_match(pattern.data(), pattern.data() + pattern.size(), text, text + length);
+    }
+}
+
+const std::string & Glob::get_pattern() const {
+    return pattern;
+}
+
+// parses a line of an ignore file, or an --include/--exclude glob, false if it holds no rule
+static bool parse_rule(std::string line, bool allow_negate, IgnoreLevel::Rule & rule) {
+    if (!line.empty() && line.back() == '\r') line.pop_back();
+    // trailing spaces are ignored unless escaped
+    while (!line.empty() && line.back() == ' ' && !(line.size() > 1 && line[line.size() - 2] == '\\')) line.pop_back();
+    if (line.empty() || line[0] == '#') return false;
+    bool negate = false;
+    if (allow_negate && line[0] == '!') {
+        negate = true;
+        line.erase(0, 1);
+    } else if (line[0] == '\\' && line.size() > 1 && (line[1] == '#' || line[1] == '!')) {
+        line.erase(0, 1);
+    }
+    bool directory_only = false;
+    while (!line.empty() && line.back() == '/') {
+        directory_only = true;
+        line.pop_back();
+    }
+    if (line.empty()) return false;
+    bool anchored = line.find('/') != std::string::npos;
+    if (line[0] == '/') line.erase(0, 1);
+    rule = {Glob(line), negate, directory_only, anchored};
+    return true;
+}
+
+bool PathFilter::matches(const IgnoreLevel::Rule & rule, const std::string & path, std::size_t base_length, std::size_t name_offset, bool is_directory) {
+    if (rule.directory_only && !is_directory) return false;
+    if (rule.anchored) {
+        if (path.size() <= base_length) return false;
+        std::size_t start = base_length;
+        while (start < path.size() && path[start] == '/') start++;
+        return rule.glob.matches(path.data() + start, path.size() - start);
+    }
+    return rule.glob.matches(path.data() + name_offset, path.size() - name_offset);
+}
+
+bool PathFilter::load(IgnoreLevel & level, const std::string & path, int dir_fd, const char * name) const {
+    std::string text;
+#ifndef _WIN32
+    if (dir_fd != -1) {
+        int fd = openat(dir_fd, name, O_RDONLY | O_CLOEXEC);
+        if (fd == -1) return false;
+        char buffer[4096];
+        while (true) {
+            auto r = ::read(fd, buffer, sizeof(buffer));
+            if (r == -1 && errno == EINTR) continue;
+            if (r <= 0) break;
+            text.append(buffer, r);
+        }
+        ::close(fd);
+    } else
+#endif
+    {
+        std::ifstream file(path + "/" + name, std::ios::binary | std::ios::in);
+        if (!file.is_open()) return false;
+        std::stringstream contents;
+        contents << file.rdbuf();
+        text = contents.str();
+    }
+    std::istringstream lines(text);
+    IgnoreLevel::Rule rule = {Glob(""), false, false, false};
+    for (std::string line; std::getline(lines, line); ) {
+        if (parse_rule(line, true, rule)) {
+            level.rules.push_back(rule);
+        }
+    }
+    return true;
+}
+
+void PathFilter::include(const std::string & glob) {
+    IgnoreLevel::Rule rule = {Glob(""), false, false, false};
+    if (parse_rule(glob, false, rule)) includes.push_back(rule);
+}
+
+void PathFilter::exclude(const std::string & glob) {
+    IgnoreLevel::Rule rule = {Glob(""), false, false, false};
+    if (parse_rule(glob, false, rule)) excludes.push_back(rule);
+}
+
+void PathFilter::use_ignore_files(bool use) {
+    ignore_files = use;
+}
+
+std::shared_ptr<const IgnoreLevel> PathFilter::enter(const std::shared_ptr<const IgnoreLevel> & parent, const std::string & path, int dir_fd) const {
+    if (!ignore_files) return parent;
+    auto level = std::make_shared<IgnoreLevel>();
+    // later rules win, so .ignore takes precedence over .gitignore
+    load(*level, path, dir_fd, ".gitignore");
+    load(*level, path, dir_fd, ".ignore");
+    if (level->rules.empty()) return parent;
+    level->parent = parent;
+    level->base = path;
+    return level;
+}
+
+bool PathFilter::skip(const IgnoreLevel * level, const std::string & path, std::size_t name_offset, std::size_t root_length, bool is_directory) const {
+    if (ignore_files && is_directory && path.compare(name_offset, std::string::npos, ".git") == 0) {
+        return true;
+    }
+    for (auto & rule : excludes) {
+        if (matches(rule, path, root_length, name_offset, is_directory)) return true;
+    }
+    // the deepest ignore file with a matching rule decides, within a file the last matching rule
+    bool decided = false;
+    for (; level != nullptr && !decided; level = level->parent.get()) {
+        for (auto rule = level->rules.rbegin(); rule != level->rules.rend(); ++rule) {
+            if (matches(*rule, path, level->base.size(), name_offset, is_directory)) {
+                if (!rule->negate) return true;
+                decided = true;
+                break;
+            }
+        }
+    }
+    if (!is_directory && !includes.empty()) {
+        for (auto & rule : includes) {
+            if (matches(rule, path, root_length, name_offset, is_directory)) return false;
+        }
+        return true;
+    }
+    return false;
+}
@@ -0,0 +1,66 @@
+#include <replacement_template.h>
+
+ReplacementTemplate::ReplacementTemplate() {}
+
+ReplacementTemplate::ReplacementTemplate(const std::string & format, std::size_t group_offset) {
+    text.reserve(format.size());
+    std::size_t literal_start = 0;
+
+    auto end_literal = [&] {
+        if (text.size() != literal_start) {
+            chunks.push_back({LITERAL, literal_start, text.size() - literal_start});
+        }
+        literal_start = text.size();
+    };
+    auto reference = [&](int group) {
+        end_literal();
+        chunks.push_back({group, 0, 0});
+        literal = false;
+    };
+
+    for (std::size_t i = 0, m = format.size(); i < m; i++) {
+        const char c = format[i];
+        if (c != '$' || i + 1 == m) {
+            text.push_back(c);
+            continue;
+        }
+        const char n = format[i+1];
+        if (n == '$') {
+            text.push_back('$');
+            i++;
+        } else if (n == '&') {
+            reference(0);
+            i++;
+        } else if (n == '`') {
+            reference(PREFIX);
+            i++;
+        } else if (n == '\'') {
+            reference(SUFFIX);
+            i++;
+        } else if (n >= '0' && n <= '9') {
+            // like std::regex_replace, at most two digits make up a group number
+            int group = n - '0';
+            i++;
+            if (i + 1 < m && format[i+1] >= '0' && format[i+1] <= '9') {
+                group = group * 10 + (format[i+1] - '0');
+                i++;
+            }
+            reference(group == 0 ? 0 : static_cast<int>(group + group_offset));
+        } else {
+            text.push_back(c);
+        }
+    }
+    end_literal();
+}
+
+bool ReplacementTemplate::is_literal() const {
+    return literal;
+}
+
+const std::string & ReplacementTemplate::literal_text() const {
+    return text;
+}
+
+const std::vector<ReplacementTemplate::Chunk> & ReplacementTemplate::get_chunks() const {
+    return chunks;
+}
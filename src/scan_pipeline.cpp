@@ -0,0 +1,277 @@
+#include <scan_pipeline.h>
+
+#include <algorithm>
+#include <iomanip>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+// the part of each file the open stage asks the kernel to read ahead, the scan reads further on its own
+static const off_t PREFETCH_SIZE = 4*1024*1024;
+
+// each queue holds this many items per scanner, enough to keep the scanners busy
+// without reading far ahead of them
+static const std::size_t ITEMS_PER_SCANNER = 16;
+
+// with `ordered`, the files submitted may run this many per scanner ahead of the output
+static const std::size_t WINDOW_PER_SCANNER = 64;
+
+// set on scanner threads
+static thread_local bool is_scanner = false;
+
+// the number of the file a scanner thread is scanning
+static thread_local std::uint64_t scanning = 0;
+
+ScanPipeline::ScanPipeline(std::size_t openers, std::size_t scanners, Scan scan, Emit emit, bool largest_first, bool ordered) :
+    scan(scan), emit(emit), largest_first(largest_first), ordered(ordered && !largest_first),
+    window(WINDOW_PER_SCANNER * (scanners == 0 ? 1 : scanners)),
+    paths(ITEMS_PER_SCANNER * scanners), opened(ITEMS_PER_SCANNER * scanners), results(ITEMS_PER_SCANNER * scanners)
+{
+    if (openers == 0) openers = 1;
+    if (scanners == 0) scanners = 1;
+    for (std::size_t i = 0; i < openers; i++) {
+        this->openers.emplace_back(&ScanPipeline::open_stage, this);
+    }
+    for (std::size_t i = 0; i < scanners; i++) {
+        this->scanners.emplace_back(&ScanPipeline::scan_stage, this);
+    }
+    emitter = std::thread(&ScanPipeline::emit_stage, this);
+    if (largest_first) {
+        dispatcher = std::thread(&ScanPipeline::dispatch_stage, this);
+    }
+}
+
+ScanPipeline::~ScanPipeline() {
+    finish();
+}
+
+std::uint64_t ScanPipeline::next_sequence() {
+    std::uint64_t sequence = submitted++;
+    if (ordered) {
+        std::unique_lock<std::mutex> lock(order_mutex);
+        if (sequence >= emitted + window) {
+            window_waits++;
+            order_advanced.wait(lock, [&] { return sequence < emitted + window; });
+        }
+    }
+    return sequence;
+}
+
+void ScanPipeline::submit(std::string path, std::uint64_t size) {
+    Item item = {next_sequence(), std::move(path), -1};
+    if (!largest_first) {
+        paths.push(std::move(item));
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(sized_mutex);
+        sized.emplace(size, std::move(item));
+        if (sized.size() > sized_max) sized_max = sized.size();
+    }
+    sized_available.notify_one();
+}
+
+void ScanPipeline::submit_output(std::string output) {
+    results.push({next_sequence(), std::move(output), -1});
+}
+
+void ScanPipeline::dispatch_stage() {
+    while (true) {
+        Item item;
+        {
+            std::unique_lock<std::mutex> lock(sized_mutex);
+            sized_available.wait(lock, [&] { return sized_closed || !sized.empty(); });
+            if (sized.empty()) return;
+            item = std::move(const_cast<Item &>(sized.top().second));
+            sized.pop();
+        }
+        // waits here while the stages after are full, so the largest file known by then goes next
+        paths.push(std::move(item));
+    }
+}
+
+void ScanPipeline::run_job(Job & job) {
+    for (std::size_t i; (i = job.next++) < job.count; ) {
+        (*job.task)(i);
+        if (++job.done == job.count) {
+            std::lock_guard<std::mutex> lock(job.done_mutex);
+            job.all_done.notify_all();
+        }
+    }
+}
+
+bool ScanPipeline::help() {
+    std::shared_ptr<Job> job;
+    {
+        std::lock_guard<std::mutex> lock(jobs_mutex);
+        for (auto & j : jobs) {
+            if (j->next < j->count) {
+                job = j;
+                break;
+            }
+        }
+    }
+    if (!job) return false;
+    run_job(*job);
+    return true;
+}
+
+void ScanPipeline::parallel_for(std::size_t count, const std::function<void(std::size_t)> & task) {
+    auto job = std::make_shared<Job>();
+    job->task = &task;
+    job->count = count;
+    {
+        std::lock_guard<std::mutex> lock(jobs_mutex);
+        jobs.push_back(job);
+    }
+    // scanners blocked waiting for a file take part too
+    opened.notify_idle();
+    run_job(*job);
+    {
+        std::lock_guard<std::mutex> lock(jobs_mutex);
+        jobs.erase(std::find(jobs.begin(), jobs.end(), job));
+    }
+    // helpers may still be running the last tasks they took
+    std::unique_lock<std::mutex> lock(job->done_mutex);
+    job->all_done.wait(lock, [&] { return job->done == count; });
+}
+
+bool ScanPipeline::on_scanner() {
+    return is_scanner;
+}
+
+bool ScanPipeline::take_turn() {
+    if (!ordered || !is_scanner) return false;
+    std::lock_guard<std::mutex> lock(order_mutex);
+    if (emitted < scanning) return false;
+    turns++;
+    return true;
+}
+
+void ScanPipeline::open_stage() {
+    Item item;
+    while (paths.pop(item)) {
+#ifndef _WIN32
+        // the scan gets the file open already, so each file is only looked up by path once
+        item.fd = ::open(item.text.c_str(), O_RDONLY | O_CLOEXEC);
+#ifdef POSIX_FADV_WILLNEED
+        if (item.fd != -1) {
+            struct stat st;
+            if (fstat(item.fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size != 0) {
+                posix_fadvise(item.fd, 0, st.st_size < PREFETCH_SIZE ? st.st_size : PREFETCH_SIZE, POSIX_FADV_WILLNEED);
+            }
+        }
+#endif
+#endif
+        opened.push(std::move(item));
+    }
+}
+
+void ScanPipeline::scan_stage() {
+    is_scanner = true;
+    Item item;
+    while (true) {
+        // parts of large files already being scanned go before new files
+        while (help()) {}
+        if (!opened.pop(item, [this] { return help(); })) break;
+        scanning = item.sequence;
+        std::string output;
+        scan(item.text, item.fd, output);
+#ifndef _WIN32
+        if (item.fd != -1) ::close(item.fd);
+#endif
+        item.fd = -1;
+        // in order, a file without output still has to be counted as emitted
+        if (ordered || output.size() != 0) {
+            item.text = std::move(output);
+            results.push(std::move(item));
+        }
+    }
+}
+
+void ScanPipeline::emit_stage() {
+    Item item;
+    if (!ordered) {
+        while (results.pop(item)) {
+            emit(item.text);
+        }
+        return;
+    }
+    // output that arrived before the output of a file submitted earlier
+    std::map<std::uint64_t, std::string> held;
+    std::size_t held_bytes = 0;
+    std::uint64_t next = 0;
+    while (results.pop(item)) {
+        if (item.sequence != next) {
+            held_bytes += item.text.size();
+            held.emplace(item.sequence, std::move(item.text));
+            held_max = std::max(held_max, held.size());
+            held_bytes_max = std::max(held_bytes_max, held_bytes);
+            continue;
+        }
+        if (item.text.size() != 0) emit(item.text);
+        next++;
+        for (auto it = held.begin(); it != held.end() && it->first == next; it = held.erase(it)) {
+            if (it->second.size() != 0) emit(it->second);
+            held_bytes -= it->second.size();
+            next++;
+        }
+        {
+            std::lock_guard<std::mutex> lock(order_mutex);
+            emitted = next;
+        }
+        order_advanced.notify_all();
+    }
+}
+
+void ScanPipeline::finish() {
+    if (finished) return;
+    finished = true;
+    // each stage is done once the one before it is done and its queue is drained
+    if (largest_first) {
+        {
+            std::lock_guard<std::mutex> lock(sized_mutex);
+            sized_closed = true;
+        }
+        sized_available.notify_all();
+        dispatcher.join();
+    }
+    paths.close();
+    for (auto & t : openers) t.join();
+    opened.close();
+    for (auto & t : scanners) t.join();
+    results.close();
+    emitter.join();
+}
+
+void ScanPipeline::print_stats(std::ostream & out) const {
+    auto print = [&](const char * name, const MPMCQueue<Item>::Stats & s) {
+        out << std::left << std::setw(16) << name << std::right
+            << " capacity " << std::setw(5) << s.capacity
+            << "  items " << std::setw(9) << s.pushes
+            << "  mean depth " << std::fixed << std::setprecision(1) << std::setw(7) << s.mean_depth
+            << "  max depth " << std::setw(5) << s.max_depth
+            << "  full " << std::setw(9) << s.full_waits
+            << "  empty " << std::setw(9) << s.empty_waits << std::endl;
+    };
+    out << "pipeline queues, a queue that is often full waits on the stage after it, one that is often empty on the stage before it:" << std::endl;
+    if (largest_first) {
+        out << std::left << std::setw(16) << "walk -> dispatch" << std::right << " files waiting, largest first, at most " << sized_max << std::endl;
+        print("dispatch -> open", paths.stats());
+    } else {
+        print("walk -> open", paths.stats());
+    }
+    print("open -> scan", opened.stats());
+    print("scan -> emit", results.stats());
+    if (ordered) {
+        out << "emitted in order, at most " << held_max << " files with " << held_bytes_max
+            << " bytes of output waited for an earlier file, the walk waited " << window_waits
+            << " times for the output to catch up within " << window << " files, "
+            << turns << " files printed their own output" << std::endl;
+    }
+}
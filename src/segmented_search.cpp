@@ -0,0 +1,145 @@
+#include <segmented_search.h>
+
+#include <algorithm>
+#include <cstring>
+#include <thread>
+
+SegmentedSearch::SegmentedSearch(const char * data, std::size_t length, const std::regex & e, std::size_t max_match_length, bool align_to_lines, Classify classify) : data(data), length(length), e(e), max_match_length(max_match_length), align_to_lines(align_to_lines), classify(classify) {}
+
+bool SegmentedSearch::search_one(std::size_t from, std::size_t limit, bool retry, bool prev_avail, SegmentMatch & match) const {
+    // an empty match at the very end of the text is still a match
+    if (from > limit || (from == limit && limit != length)) return false;
+    std::size_t range_end = std::min(length, limit + max_match_length);
+    auto flags = prev_avail ? std::regex_constants::match_prev_avail : std::regex_constants::match_default;
+    if (range_end != length) {
+        // the end of the range is not the end of the text
+        flags |= std::regex_constants::match_not_eol | std::regex_constants::match_not_eow;
+    }
+    if (retry) {
+        flags |= std::regex_constants::match_not_null | std::regex_constants::match_continuous;
+    }
+    std::cmatch m;
+    if (!std::regex_search(data + from, data + range_end, m, e, flags)) return false;
+    std::size_t position = m[0].first - data;
+    if (position > limit || (position == limit && limit != length)) return false;
+    match = {position, static_cast<std::size_t>(m.length(0)), classify(m)};
+    return true;
+}
+
+bool SegmentedSearch::search_next(SegmentMatch previous, bool first, std::size_t limit, SegmentMatch & match) const {
+    // as std::regex_iterator steps: after an empty match, first try a non empty one at the
+    // same position, then search on from the next byte, the end of the text ends it
+    std::size_t from = previous.position + previous.length;
+    if (previous.length == 0) {
+        if (from == length) return false;
+        // std::regex_iterator only passes match_prev_avail from its second step on
+        if (search_one(from, limit, true, !first, match)) return true;
+        from++;
+    }
+    return search_one(from, limit, false, true, match);
+}
+
+void SegmentedSearch::search_segment(std::size_t from, std::size_t limit, bool first, std::vector<SegmentMatch> & out) const {
+    // a segment a long line swallowed is empty, the segment before it finds the empty match at the end
+    if (from == limit && from != 0) return;
+    SegmentMatch match;
+    if (!search_one(from, limit, false, from != 0, match)) return;
+    out.push_back(match);
+    while (search_next(out.back(), first && out.size() == 1, limit, match)) {
+        out.push_back(match);
+    }
+}
+
+void SegmentedSearch::run(std::size_t segments, const ParallelFor & parallel_for) {
+    if (segments == 0) segments = 1;
+    if (segments > length) segments = length == 0 ? 1 : length;
+
+    std::vector<std::size_t> bounds(segments + 1);
+    for (std::size_t i = 0; i <= segments; i++) {
+        bounds[i] = length / segments * i;
+        if (align_to_lines && i != 0 && i != segments) {
+            auto newline = static_cast<const char *>(std::memchr(data + bounds[i], '\n', length - bounds[i]));
+            bounds[i] = newline == nullptr ? length : newline + 1 - data;
+            // a line longer than a segment swallows the next boundary
+            bounds[i] = std::max(bounds[i], bounds[i-1]);
+        }
+    }
+    bounds[segments] = length;
+
+    std::vector<std::vector<SegmentMatch>> found(segments);
+    if (parallel_for) {
+        parallel_for(segments, [&](std::size_t i) { search_segment(bounds[i], bounds[i+1], i == 0, found[i]); });
+    } else {
+        std::vector<std::thread> threads;
+        for (std::size_t i = 1; i < segments; i++) {
+            threads.emplace_back([&, i] { search_segment(bounds[i], bounds[i+1], false, found[i]); });
+        }
+        search_segment(bounds[0], bounds[1], true, found[0]);
+        for (auto & t : threads) t.join();
+    }
+
+    // stitch the segments together, in order
+    matches.clear();
+    first_match.assign(segments + 1, 0);
+    starts.assign(segments + 1, 0);
+    std::size_t resume = 0;
+    for (std::size_t i = 0; i < segments; i++) {
+        starts[i] = std::max(bounds[i], resume);
+        first_match[i] = matches.size();
+        auto & list = found[i];
+        if (i != 0 && matches.empty() && !list.empty() && list.front().length == 0) {
+            // this segment holds the first match of the text, which std::regex_iterator
+            // steps on from differently when it is empty
+            list.clear();
+            search_segment(bounds[i], bounds[i+1], true, list);
+        }
+        std::size_t next = 0;
+        if (resume > bounds[i]) {
+            // the previous segment's last match ran into this segment
+            SegmentMatch match;
+            bool found_match = search_one(resume, bounds[i+1], false, true, match);
+            bool synchronized = false;
+            while (found_match) {
+                // an empty match and a longer one can start at the same position, in that order
+                while (next < list.size() && (list[next].position < match.position ||
+                    (list[next].position == match.position && list[next].length < match.length))) next++;
+                if (next < list.size() && list[next].position == match.position && list[next].length == match.length) {
+                    // from the same match on, both searches find the same matches
+                    synchronized = true;
+                    break;
+                }
+                matches.push_back(match);
+                found_match = search_next(match, false, bounds[i+1], match);
+            }
+            if (!synchronized) next = list.size();
+        }
+        matches.insert(matches.end(), list.begin() + next, list.end());
+        std::vector<SegmentMatch>().swap(list);
+        if (matches.size() != first_match[i]) {
+            auto & last = matches.back();
+            resume = std::max(resume, last.position + last.length);
+        }
+    }
+    first_match[segments] = matches.size();
+    starts[segments] = length;
+}
+
+const std::vector<SegmentMatch> & SegmentedSearch::get_matches() const {
+    return matches;
+}
+
+std::size_t SegmentedSearch::segment_count() const {
+    return starts.size() - 1;
+}
+
+std::size_t SegmentedSearch::segment_begin(std::size_t i) const {
+    return starts[i];
+}
+
+std::size_t SegmentedSearch::segment_end(std::size_t i) const {
+    return std::max(starts[i], starts[i+1]);
+}
+
+std::size_t SegmentedSearch::first_match_of(std::size_t i) const {
+    return first_match[i];
+}
@@ -0,0 +1,99 @@
+#include <spool.h>
+
+#include <cerrno>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#ifdef _WIN32
+#include <io.h>
+#define SP_READ _read
+#define SP_WRITE _write
+#else
+#include <unistd.h>
+#define SP_READ ::read
+#define SP_WRITE ::write
+#endif
+
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+
+// the most each call moves at a time
+static const std::size_t SPOOL_CHUNK = 1024*1024;
+
+#ifdef __linux__
+// copies with `copy`, a splice() or copy_file_range() call, until it returns 0, false if
+// the kernel refused the very first call, the caller then copies the usual way
+//
+// copy_file_range() refuses an output opened with O_APPEND with EBADF, a stdout
+// redirected with >> is one
+template <typename Copy>
+static bool kernel_copy(Copy && copy, std::uint64_t & copied, bool & failed) {
+    while (true) {
+        auto r = copy();
+        if (r == 0) return true;
+        if (r == -1) {
+            if (errno == EINTR) continue;
+            if (copied == 0 && (errno == EINVAL || errno == ENOSYS || errno == EXDEV || errno == EOPNOTSUPP || errno == EBADF)) {
+                return false;
+            }
+            failed = true;
+            return true;
+        }
+        copied += r;
+    }
+}
+#endif
+
+bool spool(int in_fd, int out_fd, std::uint64_t & copied) {
+    copied = 0;
+#ifdef __linux__
+    struct stat st;
+    if (fstat(in_fd, &st) == 0) {
+        bool failed = false;
+        if (S_ISFIFO(st.st_mode)) {
+            if (kernel_copy([&] { return splice(in_fd, nullptr, out_fd, nullptr, SPOOL_CHUNK, SPLICE_F_MOVE | SPLICE_F_MORE); }, copied, failed)) {
+                return !failed;
+            }
+        }
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 27))
+        else if (S_ISREG(st.st_mode)) {
+            if (kernel_copy([&] { return copy_file_range(in_fd, nullptr, out_fd, nullptr, SPOOL_CHUNK, 0); }, copied, failed)) {
+                return !failed;
+            }
+        }
+#endif
+    }
+#endif
+    std::vector<char> buffer(SPOOL_CHUNK);
+    while (true) {
+        auto r = SP_READ(in_fd, buffer.data(), buffer.size());
+        if (r == 0) return true;
+        if (r == -1) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        std::size_t written = 0;
+        while (written < static_cast<std::size_t>(r)) {
+            auto w = SP_WRITE(out_fd, buffer.data() + written, r - written);
+            if (w == -1) {
+                if (errno == EINTR) continue;
+                return false;
+            }
+            written += w;
+        }
+        copied += r;
+    }
+}
+
+int memory_file(const char * name) {
+#ifdef __linux__
+    return memfd_create(name, MFD_CLOEXEC);
+#else
+    (void)name;
+    return -1;
+#endif
+}
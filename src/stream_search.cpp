@@ -0,0 +1,137 @@
+#include <stream_search.h>
+
+#include <algorithm>
+#include <cstring>
+
+StreamSearch::StreamSearch(const std::regex & e, std::size_t max_match_length, bool align_to_lines, std::size_t capacity, std::size_t max_line_length) :
+    e(e), max_match_length(max_match_length), align_to_lines(align_to_lines), max_line_length(max_line_length),
+    buffer(std::max(capacity, 4 * max_match_length + 2)) {}
+
+bool StreamSearch::run(const Read & read, const Span & span, const Flush & flush, bool & read_failed) {
+    read_failed = false;
+    bool found = false;
+    // [begin, filled) has not been reported yet, the search goes on from `from`,
+    // nothing before `from` can be the start of a match any more
+    std::size_t begin = 0;
+    std::size_t from = 0;
+    std::size_t filled = 0;
+    bool eof = false;
+    // the last match was empty and ended at `from`, as std::regex_iterator a non empty
+    // match at `from` is tried before the search moves on by a byte
+    bool retry = false;
+    std::uint64_t match_count = 0;
+    // the rest of a line too long to search is passed on unsearched, up to its newline
+    bool skipping = false;
+    while (!eof) {
+        if (buffer.size() - filled < buffer.size() / 4 && begin > 1) {
+            // the byte before begin stays, '^' and '\b' look at it
+            std::size_t drop = begin - 1;
+            std::memmove(buffer.data(), buffer.data() + drop, filled - drop);
+            begin -= drop;
+            from -= drop;
+            filled -= drop;
+        }
+        if (filled == buffer.size()) {
+            // only a line that does not fit gets here
+            if (buffer.size() * 2 <= max_line_length) {
+                buffer.resize(buffer.size() * 2);
+            } else {
+                span(buffer.data() + begin, buffer.data() + filled, nullptr);
+                std::memmove(buffer.data(), buffer.data() + filled - 1, 1);
+                begin = from = filled = 1;
+                retry = false;
+                skipping = true;
+                long_lines++;
+            }
+        }
+        const char * data = buffer.data();
+
+        std::size_t before = filled;
+        auto r = read(buffer.data() + filled, buffer.size() - filled);
+        if (r < 0) {
+            read_failed = true;
+            eof = true;
+        } else if (r == 0) {
+            eof = true;
+        } else {
+            filled += r;
+            total += r;
+        }
+
+        if (skipping) {
+            auto newline = static_cast<const char *>(std::memchr(data + from, '\n', filled - from));
+            from = newline == nullptr ? filled : newline + 1 - data;
+            skipping = newline == nullptr;
+        }
+
+        // a match starting before limit is the same whatever comes next
+        std::size_t limit = from;
+        std::size_t range_end = filled;
+        if (eof) {
+            limit = filled;
+        } else if (align_to_lines) {
+            // any newline before the new data is before `from` already
+            for (std::size_t i = filled; i > std::max(before, from); i--) {
+                if (data[i-1] == '\n') {
+                    limit = i;
+                    break;
+                }
+            }
+            range_end = limit;
+        } else if (filled > max_match_length) {
+            limit = std::max(from, filled - max_match_length);
+        }
+
+        auto flags = std::regex_constants::match_default;
+        if (!eof) {
+            // the end of the range is not the end of the stream
+            flags |= std::regex_constants::match_not_eol | std::regex_constants::match_not_eow;
+        }
+        // only the end of the stream is a position past the last byte of its own
+        while (!skipping && (from < limit || (eof && from == filled))) {
+            std::cmatch m;
+            if (retry) {
+                // the end of the stream ends it after an empty match there
+                if (from == filled) break;
+                // std::regex_iterator only passes match_prev_avail from its second step on
+                auto retry_flags = flags | std::regex_constants::match_not_null | std::regex_constants::match_continuous;
+                if (match_count > 1) retry_flags |= std::regex_constants::match_prev_avail;
+                retry = false;
+                if (!std::regex_search(data + from, data + range_end, m, e, retry_flags)) {
+                    from++;
+                    continue;
+                }
+            } else {
+                auto from_flags = from == 0 ? flags : flags | std::regex_constants::match_prev_avail;
+                if (!std::regex_search(data + from, data + range_end, m, e, from_flags)) break;
+                if (static_cast<std::size_t>(m[0].first - data) >= limit && !eof) break;
+            }
+            std::size_t position = m[0].first - data;
+            std::size_t length = m.length(0);
+            if (position != begin) span(data + begin, data + position, nullptr);
+            span(data + position, data + position + length, &m);
+            if (length != 0) found = true;
+            match_count++;
+            begin = from = position + length;
+            retry = length == 0;
+        }
+        // past an empty match the retry at `from` is still to come
+        if (!retry) from = std::min(std::max(from, limit), filled);
+
+        std::size_t settled = eof ? filled : from;
+        if (settled > begin) {
+            span(data + begin, data + settled, nullptr);
+            begin = settled;
+        }
+        if (flush && !flush()) break;
+    }
+    return found;
+}
+
+std::uint64_t StreamSearch::size() const {
+    return total;
+}
+
+std::uint64_t StreamSearch::skipped_lines() const {
+    return long_lines;
+}
@@ -0,0 +1,97 @@
+#include <thread_pool.h>
+
+// the pool and worker index of the calling thread, if it is a worker
+static thread_local ThreadPool * current_pool = nullptr;
+static thread_local std::size_t current_index = 0;
+
+ThreadPool::ThreadPool(std::size_t threads) {
+    if (threads == 0) threads = 1;
+    for (std::size_t i = 0; i < threads; i++) {
+        workers.emplace_back(new Worker());
+    }
+    for (std::size_t i = 0; i < threads; i++) {
+        this->threads.emplace_back(&ThreadPool::run, this, i);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    wait();
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    work_available.notify_all();
+    for (auto & t : threads) t.join();
+}
+
+void ThreadPool::submit(Task task) {
+    std::size_t index = current_pool == this ? current_index : next_worker++ % workers.size();
+    pending++;
+    {
+        std::lock_guard<std::mutex> lock(workers[index]->mutex);
+        workers[index]->tasks.push_back(std::move(task));
+    }
+    queued++;
+    {
+        // taking the lock orders the increment before a sleeping worker's check of queued
+        std::lock_guard<std::mutex> lock(mutex);
+    }
+    work_available.notify_one();
+}
+
+bool ThreadPool::pop(std::size_t index, Task & task) {
+    {
+        Worker & own = *workers[index];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.tasks.empty()) {
+            task = std::move(own.tasks.back());
+            own.tasks.pop_back();
+            queued--;
+            return true;
+        }
+    }
+    for (std::size_t i = 1; i < workers.size(); i++) {
+        Worker & victim = *workers[(index + i) % workers.size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.tasks.empty()) {
+            task = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+            queued--;
+            return true;
+        }
+    }
+    return false;
+}
+
+void ThreadPool::run(std::size_t index) {
+    current_pool = this;
+    current_index = index;
+    Task task;
+    while (true) {
+        if (pop(index, task)) {
+            task();
+            task = nullptr;
+            if (--pending == 0) {
+                std::lock_guard<std::mutex> lock(mutex);
+                all_done.notify_all();
+            }
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(mutex);
+        work_available.wait(lock, [&] { return stopping || queued != 0; });
+        if (stopping && queued == 0) return;
+    }
+}
+
+void ThreadPool::wait() {
+    std::unique_lock<std::mutex> lock(mutex);
+    all_done.wait(lock, [&] { return pending == 0; });
+}
+
+std::size_t ThreadPool::size() const {
+    return workers.size();
+}
+
+bool ThreadPool::on_worker() {
+    return current_pool != nullptr;
+}
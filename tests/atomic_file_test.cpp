@@ -0,0 +1,132 @@
+#include "test.h"
+
+#include <atomic_file.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+#include <dirent.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static std::string temp_directory(const char * name) {
+    const char * tmp = getenv("TMPDIR");
+    std::string path = std::string(tmp != nullptr ? tmp : "/tmp") + "/" + name;
+    mkdir(path.c_str(), 0755);
+    return path;
+}
+
+static void write_text(const std::string & path, const std::string & text) {
+    std::ofstream(path, std::ios::binary) << text;
+}
+
+static std::string read_text(const std::string & path) {
+    std::ifstream in(path, std::ios::binary);
+    std::stringstream text;
+    text << in.rdbuf();
+    return text.str();
+}
+
+// the names in a directory, apart from "." and ".."
+static std::size_t entries(const std::string & directory) {
+    std::size_t count = 0;
+    DIR * dir = opendir(directory.c_str());
+    if (dir == nullptr) return 0;
+    while (auto entry = readdir(dir)) {
+        std::string name = entry->d_name;
+        if (name != "." && name != "..") count++;
+    }
+    closedir(dir);
+    return count;
+}
+
+static bool write_all(int fd, const std::string & text) {
+    return write(fd, text.data(), text.size()) == static_cast<ssize_t>(text.size());
+}
+
+TEST(atomic_file_commit_replaces_the_file) {
+    auto dir = temp_directory("FindReplaceTests_atomic_commit");
+    auto path = dir + "/file.txt";
+    write_text(path, "old contents");
+    chmod(path.c_str(), 0640);
+    {
+        AtomicFile file(path.c_str());
+        CHECK(file.is_open());
+        CHECK(write_all(file.get_fd(), "new"));
+        // nothing changes until the commit
+        CHECK_EQUAL(read_text(path), std::string("old contents"));
+        CHECK(file.commit());
+    }
+    CHECK_EQUAL(read_text(path), std::string("new"));
+    struct stat st;
+    CHECK(stat(path.c_str(), &st) == 0 && (st.st_mode & 07777) == 0640);
+    // the temporary file took the place of the old one, nothing is left beside it
+    CHECK_EQUAL(entries(dir), std::size_t(1));
+    std::remove(path.c_str());
+    rmdir(dir.c_str());
+}
+
+TEST(atomic_file_abort_leaves_the_file) {
+    auto dir = temp_directory("FindReplaceTests_atomic_abort");
+    auto path = dir + "/file.txt";
+    write_text(path, "old contents");
+    {
+        AtomicFile file(path.c_str());
+        CHECK(write_all(file.get_fd(), "discarded"));
+        file.discard();
+        CHECK(!file.is_open());
+        CHECK(!file.commit());
+    }
+    {
+        // destroyed without a commit
+        AtomicFile file(path.c_str());
+        CHECK(write_all(file.get_fd(), "dropped"));
+    }
+    CHECK_EQUAL(read_text(path), std::string("old contents"));
+    CHECK_EQUAL(entries(dir), std::size_t(1));
+    std::remove(path.c_str());
+    rmdir(dir.c_str());
+}
+
+TEST(atomic_file_replaces_the_target_of_a_symlink) {
+    auto dir = temp_directory("FindReplaceTests_atomic_symlink");
+    auto target = dir + "/target.txt";
+    auto link = dir + "/link.txt";
+    write_text(target, "old contents");
+    std::remove(link.c_str());
+    CHECK(symlink("target.txt", link.c_str()) == 0);
+    {
+        AtomicFile file(link.c_str());
+        CHECK(write_all(file.get_fd(), "new"));
+        CHECK(file.commit());
+    }
+    struct stat st;
+    CHECK(lstat(link.c_str(), &st) == 0 && S_ISLNK(st.st_mode));
+    CHECK_EQUAL(read_text(target), std::string("new"));
+    CHECK_EQUAL(entries(dir), std::size_t(2));
+    std::remove(link.c_str());
+    std::remove(target.c_str());
+    rmdir(dir.c_str());
+}
+
+TEST(atomic_file_commit_in_the_current_directory) {
+    // a path without a directory, the rename is synced in the directory the path resolves to
+    auto dir = temp_directory("FindReplaceTests_atomic_cwd");
+    char cwd[4096];
+    CHECK(getcwd(cwd, sizeof(cwd)) != nullptr);
+    CHECK(chdir(dir.c_str()) == 0);
+    write_text("file.txt", "old contents");
+    {
+        AtomicFile file("file.txt");
+        CHECK(write_all(file.get_fd(), "new"));
+        CHECK(file.commit());
+    }
+    CHECK_EQUAL(read_text("file.txt"), std::string("new"));
+    CHECK_EQUAL(entries("."), std::size_t(1));
+    std::remove("file.txt");
+    CHECK(chdir(cwd) == 0);
+    rmdir(dir.c_str());
+}
@@ -0,0 +1,65 @@
+#include "test.h"
+
+#include <binary_sniff.h>
+
+#include <string>
+
+static bool binary(const std::string & data) {
+    return looks_binary(data.data(), data.size());
+}
+
+TEST(sniff_text_encodings) {
+    CHECK(!binary(""));
+    CHECK(!binary("plain ASCII text\r\n\twith\fwhitespace\v\n"));
+    CHECK(!binary("\x1b[31mcolored\x1b[0m log line\n"));
+    CHECK(!binary("caf\xc3\xa9 na\xc3\xafve \xe2\x82\xac 5\n"));
+    // Latin-1 and CP1252 are not valid UTF-8, they are still text
+    CHECK(!binary("caf\xe9 na\xefve\n"));
+    CHECK(!binary("\x93quoted\x94 \x80 5\n"));
+    // UTF-16 is half NUL bytes, its byte order mark gives it away
+    CHECK(!binary(std::string("\xff\xfeh\0i\0\n\0", 8)));
+    CHECK(!binary(std::string("\xfe\xff\0h\0i\0\n", 8)));
+}
+
+TEST(sniff_nul_anywhere) {
+    std::string text(100, 'a');
+    for (std::size_t i = 0; i < text.size(); i++) {
+        std::string data = text;
+        data[i] = '\0';
+        CHECK(binary(data));
+    }
+    CHECK(binary(std::string("h\0i\0\n\0", 6)));
+}
+
+TEST(sniff_control_density) {
+    std::string sparse;
+    for (int i = 0; i < 50; i++) sparse += std::string(19, 'a') + "\x01";
+    CHECK(!binary(sparse));
+    std::string dense;
+    for (int i = 0; i < 50; i++) dense += std::string(4, 'a') + "\x01";
+    CHECK(binary(dense));
+    CHECK(binary("\x7f" "ELF\x02\x01\x01"));
+}
+
+TEST(sniff_latin1_and_utf16) {
+    // every byte from 0x80 up, as Latin-1 or CP1252 text has them
+    std::string high;
+    for (int c = 0x80; c <= 0xFF; c++) high += static_cast<char>(c);
+    CHECK(!binary("text " + high + "\n"));
+    // UTF-16 with a byte order mark may hold anything, without one its NUL bytes make it binary
+    CHECK(!binary(std::string("\xff\xfe\xe9\0\x01\0\0\0", 8)));
+    CHECK(binary(std::string("\xff", 1) + std::string("\0\0", 2)));
+}
+
+TEST(sniff_control_ratio_threshold) {
+    // one control character in every BINARY_CONTROL_RATIO bytes is still text, one more is not
+    std::string limit;
+    for (int i = 0; i < 50; i++) limit += std::string(BINARY_CONTROL_RATIO - 1, 'a') + "\x01";
+    CHECK(!binary(limit));
+    CHECK(binary(limit + "\x02"));
+    CHECK(!binary(limit + std::string(BINARY_CONTROL_RATIO, 'a') + "\x02"));
+    // whitespace, backspace and escape never count
+    std::string controls;
+    for (int i = 0; i < 50; i++) controls += "\t\n\v\f\r\b\x1b";
+    CHECK(!binary(controls));
+}
@@ -0,0 +1,79 @@
+#include "test.h"
+
+#include <json_record.h>
+#include <output_sink.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <string>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+// the lines a record writes through an OutputBuffer
+static std::string record(const std::function<void(JsonRecord &)> & fields) {
+    const char * tmp = getenv("TMPDIR");
+    std::string path = std::string(tmp != nullptr ? tmp : "/tmp") + "/FindReplaceTests_json";
+    int fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    {
+        OutputSink sink(fd);
+        OutputBuffer out(sink);
+        JsonRecord record(out);
+        fields(record);
+        record.end();
+    }
+    std::string text;
+    char buffer[4096];
+    ssize_t r;
+    lseek(fd, 0, SEEK_SET);
+    while ((r = read(fd, buffer, sizeof(buffer))) > 0) text.append(buffer, r);
+    close(fd);
+    std::remove(path.c_str());
+    return text;
+}
+
+static std::string string_field(const std::string & value) {
+    return record([&](JsonRecord & r) { r.string("s", value.data(), value.size()); });
+}
+
+TEST(json_record_fields) {
+    CHECK_EQUAL(record([](JsonRecord &) {}), std::string("{}\n"));
+    CHECK_EQUAL(record([](JsonRecord & r) {
+        r.string("path", "a.txt", 5).number("offset", 18446744073709551615u).number("line", 0);
+    }), std::string("{\"path\":\"a.txt\",\"offset\":18446744073709551615,\"line\":0}\n"));
+}
+
+TEST(json_record_escapes_control_characters) {
+    CHECK_EQUAL(string_field("say \"hi\" \\ bye"), std::string("{\"s\":\"say \\\"hi\\\" \\\\ bye\"}\n"));
+    CHECK_EQUAL(string_field("a\nb\rc\td"), std::string("{\"s\":\"a\\nb\\rc\\td\"}\n"));
+    CHECK_EQUAL(string_field(std::string("\0\x01\x1f\x7f", 4)), std::string("{\"s\":\"\\u0000\\u0001\\u001f\x7f\"}\n"));
+}
+
+TEST(json_record_utf8) {
+    // valid sequences of every length are written as they are
+    std::string text = "caf\xc3\xa9 \xe2\x82\xac \xf0\x9f\x98\x80";
+    CHECK_EQUAL(string_field(text), "{\"s\":\"" + text + "\"}\n");
+    // stray continuation bytes, overlong forms, surrogates and cut off sequences are not,
+    // the whole value is then written in base64
+    CHECK_EQUAL(string_field("\x80"), std::string("{\"s\":{\"bytes\":\"gA==\"}}\n"));
+    CHECK_EQUAL(string_field("\xc0\xaf"), std::string("{\"s\":{\"bytes\":\"wK8=\"}}\n"));
+    CHECK_EQUAL(string_field("\xed\xa0\x80"), std::string("{\"s\":{\"bytes\":\"7aCA\"}}\n"));
+    CHECK_EQUAL(string_field("x\xe2\x82"), std::string("{\"s\":{\"bytes\":\"eOKC\"}}\n"));
+    CHECK_EQUAL(string_field("\xf4\x90\x80\x80"), std::string("{\"s\":{\"bytes\":\"9JCAgA==\"}}\n"));
+    // escapes are left to base64 too
+    CHECK_EQUAL(string_field("\"a\"\n\xff"), std::string("{\"s\":{\"bytes\":\"ImEiCv8=\"}}\n"));
+}
+
+TEST(json_record_string_parts) {
+    auto parts = record([](JsonRecord & r) {
+        r.begin_string("s").string_part("ab", 2).string_part("\"\n", 2).string_part("", 0).end_string().number("n", 1);
+    });
+    CHECK_EQUAL(parts, std::string("{\"s\":\"ab\\\"\\n\",\"n\":1}\n"));
+    // a sequence split between parts is still valid
+    auto split = record([](JsonRecord & r) {
+        r.begin_string("s").string_part("\xe2\x82", 2).string_part("\xac", 1).end_string();
+        r.begin_string("t").string_part("\xe2", 1).string_part("x", 1).end_string();
+    });
+    CHECK_EQUAL(split, std::string("{\"s\":\"\xe2\x82\xac\",\"t\":{\"bytes\":\"4ng=\"}}\n"));
+}
@@ -0,0 +1,37 @@
+#include "test.h"
+
+#include <line_count.h>
+
+#include <algorithm>
+#include <string>
+
+static std::size_t naive(const char * data, std::size_t length) {
+    return std::count(data, data + length, '\n');
+}
+
+TEST(count_newlines_every_alignment) {
+    std::string text;
+    for (int i = 0; i < 300; i++) {
+        text += std::string(i % 13, 'x') + "\n";
+        // bytes one off from '\n' in either direction must not count
+        if (i % 5 == 0) text += "\x0b\x09\x8a";
+    }
+    for (std::size_t start = 0; start < 16; start++) {
+        for (std::size_t length : {0, 1, 7, 8, 9, 63, 64, 65, 500}) {
+            length = std::min(length, text.size() - start);
+            CHECK_EQUAL(count_newlines(text.data() + start, length), naive(text.data() + start, length));
+        }
+        CHECK_EQUAL(count_newlines(text.data() + start, text.size() - start), naive(text.data() + start, text.size() - start));
+    }
+}
+
+TEST(count_newlines_byte_counter_overflow) {
+    // every byte lane counts one newline per word, past the 255 words a lane can hold
+    std::string lines(8 * 1000, '\n');
+    CHECK_EQUAL(count_newlines(lines.data(), lines.size()), lines.size());
+    CHECK_EQUAL(count_newlines(lines.data() + 3, lines.size() - 5), lines.size() - 5);
+
+    std::string mixed;
+    for (int i = 0; i < 5000; i++) mixed += i % 3 ? "\n\n\n\n\n\n\n\n" : "ab\ncd\n\nx";
+    CHECK_EQUAL(count_newlines(mixed.data(), mixed.size()), naive(mixed.data(), mixed.size()));
+}
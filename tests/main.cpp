@@ -0,0 +1,18 @@
+#include "test.h"
+
+int test_failures = 0;
+
+std::vector<TestCase> & test_cases() {
+    static std::vector<TestCase> cases;
+    return cases;
+}
+
+int main() {
+    for (auto & test : test_cases()) {
+        int failures = test_failures;
+        test.run();
+        std::cout << (test_failures == failures ? "passed: " : "FAILED: ") << test.name << std::endl;
+    }
+    std::cout << test_cases().size() << " tests, " << test_failures << " failed checks" << std::endl;
+    return test_failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,88 @@
+#include "test.h"
+
+#include <match_log.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <tuple>
+
+static std::string temporary_path(const char * name) {
+    const char * tmp = getenv("TMPDIR");
+    return std::string(tmp != nullptr ? tmp : "/tmp") + "/" + name;
+}
+
+TEST(match_log_round_trip) {
+    auto path = temporary_path("FindReplaceTests_matches");
+    // a match of file, offset, length and pattern
+    using Match = std::tuple<std::uint32_t, std::uint64_t, std::uint64_t, std::uint32_t>;
+    std::vector<Match> written;
+    {
+        MatchLog log(path.c_str());
+        CHECK(log.is_open());
+        auto large = log.add_file("dir/large.txt");
+        auto small = log.add_file("<stdin>");
+        log.add_file("no matches");
+        // more than a block on one thread, the first block is written before finish()
+        std::size_t count = MatchLog::BLOCK_CAPACITY + 10;
+        std::thread other([&] {
+            for (std::uint64_t i = 0; i < 100; i++) log.add(small, i * 3, 2, 1);
+        });
+        for (std::uint64_t i = 0; i < count; i++) log.add(large, i * 10 + (1ull << 33), i % 7 + 1, i % 3);
+        other.join();
+        CHECK(log.finish());
+        for (std::uint64_t i = 0; i < count; i++) written.emplace_back(large, i * 10 + (1ull << 33), i % 7 + 1, i % 3);
+        for (std::uint64_t i = 0; i < 100; i++) written.emplace_back(small, i * 3, 2, 1);
+    }
+
+    MatchLogReader reader(path.c_str());
+    CHECK(reader.is_open());
+    CHECK_EQUAL(reader.get_error(), std::string());
+    CHECK_EQUAL(reader.match_count(), std::uint64_t(written.size()));
+    CHECK_EQUAL(reader.path_count(), std::size_t(3));
+    CHECK(reader.path(0) == "dir/large.txt");
+    CHECK(reader.path(1) == "<stdin>");
+    CHECK(reader.path(2) == "no matches");
+    CHECK(reader.block_count() >= 2);
+
+    // blocks of different threads may be in any order, the matches of each file stay in order
+    std::vector<std::vector<Match>> read(3);
+    for (std::size_t b = 0; b < reader.block_count(); b++) {
+        auto block = reader.block(b);
+        for (std::size_t i = 0; i < block.count; i++) {
+            CHECK(block.file[i] < 3);
+            if (block.file[i] < 3) read[block.file[i]].emplace_back(block.file[i], block.offset[i], block.length[i], block.pattern[i]);
+        }
+    }
+    std::vector<Match> all;
+    for (auto & matches : read) all.insert(all.end(), matches.begin(), matches.end());
+    CHECK(all == written);
+    std::remove(path.c_str());
+}
+
+TEST(match_log_rejects_broken_files) {
+    auto path = temporary_path("FindReplaceTests_broken");
+    CHECK(!MatchLogReader(path.c_str()).is_open());
+
+    std::ofstream(path, std::ios::binary | std::ios::trunc) << "not a --binary-results file, but long enough to have a footer";
+    MatchLogReader reader(path.c_str());
+    CHECK(!reader.is_open());
+    CHECK(!reader.get_error().empty());
+
+    // a complete log cut short loses its footer
+    {
+        MatchLog log(path.c_str());
+        log.add(log.add_file("a"), 1, 2, 0);
+        CHECK(log.finish());
+    }
+    std::string contents;
+    {
+        std::ifstream file(path, std::ios::binary);
+        contents.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    }
+    std::ofstream(path, std::ios::binary | std::ios::trunc) << contents.substr(0, contents.size() - 8);
+    CHECK(!MatchLogReader(path.c_str()).is_open());
+    std::remove(path.c_str());
+}
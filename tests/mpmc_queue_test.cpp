@@ -0,0 +1,145 @@
+#include "test.h"
+
+#include <mpmc_queue.h>
+
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+TEST(mpmc_queue_capacity_and_order) {
+    MPMCQueue<int> queue(5);
+    CHECK_EQUAL(queue.stats().capacity, std::size_t(8));
+    CHECK_EQUAL(MPMCQueue<int>(0).stats().capacity, std::size_t(2));
+    CHECK_EQUAL(MPMCQueue<int>(16).stats().capacity, std::size_t(16));
+
+    int value = 0;
+    CHECK(!queue.try_pop(value));
+    for (int i = 0; i < 8; i++) {
+        value = i;
+        CHECK(queue.try_push(value));
+    }
+    value = 8;
+    CHECK(!queue.try_push(value));
+    CHECK_EQUAL(queue.depth(), std::size_t(8));
+    for (int i = 0; i < 8; i++) {
+        CHECK(queue.try_pop(value));
+        CHECK_EQUAL(value, i);
+    }
+    CHECK(!queue.try_pop(value));
+
+    // many laps around the ring keep the order
+    for (int i = 0; i < 1000; i++) {
+        queue.push(i);
+        if (i % 3 == 2) {
+            for (int j = i - 2; j <= i; j++) {
+                CHECK(queue.pop(value));
+                CHECK_EQUAL(value, j);
+            }
+        }
+    }
+    CHECK_EQUAL(queue.depth(), std::size_t(1));
+}
+
+TEST(mpmc_queue_close_drains) {
+    MPMCQueue<std::string> queue(4);
+    queue.push("a");
+    queue.push("b");
+    queue.close();
+    std::string value;
+    CHECK(queue.pop(value));
+    CHECK_EQUAL(value, std::string("a"));
+    CHECK(queue.pop(value));
+    CHECK_EQUAL(value, std::string("b"));
+    CHECK(!queue.pop(value));
+}
+
+TEST(mpmc_queue_many_producers_and_consumers) {
+    const int producers = 4, consumers = 4, items = 20000;
+    // a small queue, so producers wait for consumers and the other way round
+    MPMCQueue<int> queue(8);
+    std::vector<std::vector<int>> popped(consumers);
+    std::vector<std::thread> threads;
+    for (int c = 0; c < consumers; c++) {
+        threads.emplace_back([&, c] {
+            int value;
+            while (queue.pop(value)) popped[c].push_back(value);
+        });
+    }
+    std::vector<std::thread> pushing;
+    for (int p = 0; p < producers; p++) {
+        pushing.emplace_back([&, p] {
+            for (int i = 0; i < items; i++) queue.push(p * items + i);
+        });
+    }
+    for (auto & t : pushing) t.join();
+    queue.close();
+    for (auto & t : threads) t.join();
+
+    std::vector<int> seen(producers * items, 0);
+    bool in_order = true;
+    for (auto & values : popped) {
+        // a consumer sees the items of each producer in the order they were pushed
+        std::vector<int> last(producers, -1);
+        for (int value : values) {
+            seen[value]++;
+            int p = value / items;
+            if (value <= last[p]) in_order = false;
+            last[p] = value;
+        }
+    }
+    bool once = true;
+    for (int count : seen) {
+        if (count != 1) once = false;
+    }
+    CHECK(once);
+    CHECK(in_order);
+    CHECK_EQUAL(queue.stats().pushes, std::uint64_t(producers * items));
+}
+
+TEST(mpmc_queue_blocked_waits_wake_up) {
+    MPMCQueue<int> queue(2);
+    std::atomic<int> idle_calls {0};
+    std::atomic<bool> has_work {false};
+    int popped = -1;
+    std::thread consumer([&] {
+        queue.pop(popped, [&] {
+            idle_calls++;
+            return has_work.exchange(false);
+        });
+    });
+    // long enough for the consumer to stop spinning and block
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    int calls = idle_calls;
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    // a blocked pop does not keep calling idle
+    CHECK_EQUAL(idle_calls.load(), calls);
+    has_work = true;
+    queue.notify_idle();
+    while (has_work) std::this_thread::yield();
+    queue.push(7);
+    consumer.join();
+    CHECK_EQUAL(popped, 7);
+
+    // a full queue blocks the producer until a pop makes room
+    queue.push(1);
+    queue.push(2);
+    std::atomic<bool> pushed {false};
+    std::thread producer([&] {
+        queue.push(3);
+        pushed = true;
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    CHECK(!pushed);
+    int value;
+    CHECK(queue.pop(value));
+    producer.join();
+    CHECK(pushed);
+    queue.close();
+    for (int expected : {2, 3}) {
+        CHECK(queue.pop(value));
+        CHECK_EQUAL(value, expected);
+    }
+    CHECK(!queue.pop(value));
+}
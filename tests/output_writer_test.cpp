@@ -0,0 +1,211 @@
+#include "test.h"
+
+#include <output_writer.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <unistd.h>
+
+static std::string temp_path(const char * name) {
+    const char * tmp = getenv("TMPDIR");
+    return std::string(tmp != nullptr ? tmp : "/tmp") + "/" + name;
+}
+
+static std::string read_text(const std::string & path) {
+    std::ifstream in(path, std::ios::binary);
+    std::stringstream text;
+    text << in.rdbuf();
+    return text.str();
+}
+
+// bytes that differ from one offset to the next, so a misplaced region shows
+static std::string pattern(std::size_t length, unsigned seed) {
+    std::string text(length, '\0');
+    for (std::size_t i = 0; i < length; i++) {
+        text[i] = static_cast<char>('a' + (i * 7 + i / 251 + seed) % 26);
+    }
+    return text;
+}
+
+// a source file holding `text`, which stands in for its mapping
+static int source_file(const std::string & path, const std::string & text) {
+    std::ofstream(path, std::ios::binary) << text;
+    return open(path.c_str(), O_RDONLY);
+}
+
+// writes short replacements between regions of the source, some of them long
+// enough to be copied by the kernel, and returns what the file must hold
+static std::string write_mix(OutputWriter & writer, const std::string & source) {
+    std::string expected;
+    std::size_t offset = 0;
+    for (std::size_t length : {10, 70000, 3, 100000, 65536, 1, 200}) {
+        if (offset + length > source.size()) break;
+        writer.copy(offset, length);
+        expected.append(source, offset, length);
+        std::string replacement = "<" + std::to_string(offset) + ">";
+        writer.write(replacement.data(), replacement.size());
+        expected += replacement;
+        offset += length + 5;
+    }
+    return expected;
+}
+
+TEST(output_writer_copies_between_files) {
+    auto source = pattern(300000, 1);
+    auto src_path = temp_path("FindReplaceTests_writer_src");
+    auto out_path = temp_path("FindReplaceTests_writer_out");
+    int src = source_file(src_path, source);
+    int out = open(out_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    std::string expected;
+    {
+        OutputWriter writer(out, src, source.data());
+        expected = write_mix(writer, source);
+        CHECK(writer.flush());
+        CHECK(writer.ok());
+        CHECK_EQUAL(writer.written(), std::uint64_t(expected.size()));
+    }
+    CHECK(read_text(out_path) == expected);
+    close(out);
+    close(src);
+    std::remove(src_path.c_str());
+    std::remove(out_path.c_str());
+}
+
+TEST(output_writer_fills_parts_at_offsets) {
+    auto source = pattern(200000, 2);
+    auto src_path = temp_path("FindReplaceTests_writer_src");
+    auto out_path = temp_path("FindReplaceTests_writer_out");
+    int src = source_file(src_path, source);
+    int out = open(out_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    {
+        // the second half is written first, each writer keeps to its own part
+        OutputWriter second(out, src, source.data(), 100000);
+        second.copy(100000, 100000);
+        CHECK(second.flush());
+        OutputWriter first(out, src, source.data(), 0);
+        first.write("0123456789", 10);
+        first.copy(10, 99990);
+        CHECK(first.flush());
+    }
+    CHECK(read_text(out_path) == "0123456789" + source.substr(10));
+    close(out);
+    close(src);
+    std::remove(src_path.c_str());
+    std::remove(out_path.c_str());
+}
+
+TEST(output_writer_falls_back_when_the_kernel_cannot_copy) {
+    auto source = pattern(300000, 3);
+    auto src_path = temp_path("FindReplaceTests_writer_src");
+    auto out_path = temp_path("FindReplaceTests_writer_out");
+    int src = source_file(src_path, source);
+
+    // copy_file_range() refuses a file opened for appending
+    std::ofstream(out_path, std::ios::binary) << "head ";
+    int out = open(out_path.c_str(), O_WRONLY | O_APPEND);
+    std::string expected = "head ";
+    {
+        OutputWriter writer(out, src, source.data());
+        expected += write_mix(writer, source);
+        CHECK(writer.flush());
+        CHECK(writer.ok());
+    }
+    CHECK(read_text(out_path) == expected);
+    close(out);
+
+    // and a pipe
+    int fds[2];
+    CHECK(pipe(fds) == 0);
+    std::string piped;
+    std::thread reader([&] {
+        char buffer[4096];
+        ssize_t r;
+        while ((r = read(fds[0], buffer, sizeof(buffer))) > 0) piped.append(buffer, r);
+    });
+    {
+        OutputWriter writer(fds[1], src, source.data());
+        expected = write_mix(writer, source);
+        CHECK(writer.flush());
+        CHECK(writer.ok());
+    }
+    close(fds[1]);
+    reader.join();
+    close(fds[0]);
+    CHECK(piped == expected);
+
+    close(src);
+    std::remove(src_path.c_str());
+    std::remove(out_path.c_str());
+}
+
+static void interrupt(int) {}
+
+TEST(output_writer_finishes_partial_writes) {
+    // a write into a full pipe that is interrupted by a signal returns what it
+    // wrote so far, the writer has to carry on from the middle of an iovec
+    struct sigaction action = {}, old_action;
+    action.sa_handler = interrupt;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGUSR1, &action, &old_action);
+
+    int fds[2];
+    CHECK(pipe(fds) == 0);
+#ifdef F_SETPIPE_SZ
+    fcntl(fds[1], F_SETPIPE_SZ, 4096);
+#endif
+    std::string piped;
+    std::thread reader([&] {
+        char buffer[1000];
+        ssize_t r;
+        while ((r = read(fds[0], buffer, sizeof(buffer))) > 0) {
+            piped.append(buffer, r);
+            std::this_thread::sleep_for(std::chrono::microseconds(20));
+        }
+    });
+    std::atomic<bool> writing {true};
+    pthread_t writer_thread = pthread_self();
+    std::thread interrupter([&] {
+        while (writing) {
+            pthread_kill(writer_thread, SIGUSR1);
+            std::this_thread::sleep_for(std::chrono::microseconds(200));
+        }
+    });
+
+    std::string expected;
+    std::vector<std::string> pieces;
+    for (int i = 0; i < 3000; i++) pieces.push_back(pattern(1 + i % 97, i) + "|");
+    bool flushed;
+    {
+        OutputWriter writer(fds[1], -1, nullptr);
+        for (auto & piece : pieces) {
+            // stable pieces each get their own iovec, copies are merged into the scratch buffer
+            if (piece.size() % 2) {
+                writer.write_stable(piece.data(), piece.size());
+            } else {
+                writer.write(piece.data(), piece.size());
+            }
+            expected += piece;
+        }
+        flushed = writer.flush();
+    }
+    writing = false;
+    interrupter.join();
+    close(fds[1]);
+    reader.join();
+    close(fds[0]);
+    sigaction(SIGUSR1, &old_action, nullptr);
+    CHECK(flushed);
+    CHECK_EQUAL(piped.size(), expected.size());
+    CHECK(piped == expected);
+}
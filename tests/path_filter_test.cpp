@@ -0,0 +1,117 @@
+#include "test.h"
+
+#include <path_filter.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <string>
+
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <direct.h>
+#define mkdir(path, mode) _mkdir(path)
+#define rmdir _rmdir
+#else
+#include <unistd.h>
+#endif
+
+static bool glob(const char * pattern, const char * text) {
+    return Glob(pattern).matches(text, strlen(text));
+}
+
+TEST(glob_literal_and_suffix) {
+    CHECK(glob("main.cpp", "main.cpp"));
+    CHECK(!glob("main.cpp", "main.cp"));
+    CHECK(!glob("main.cpp", "xmain.cpp"));
+    CHECK(glob("*.o", "a.o"));
+    CHECK(glob("*.o", ".o"));
+    CHECK(!glob("*.o", "a.obj"));
+    // a single '*' never crosses a '/'
+    CHECK(!glob("*.o", "dir/a.o"));
+}
+
+TEST(glob_wildcards_and_classes) {
+    CHECK(glob("a?c", "abc"));
+    CHECK(!glob("a?c", "a/c"));
+    CHECK(glob("lib*.so.*", "libfoo.so.1"));
+    CHECK(!glob("lib*.so.*", "libfoo.so"));
+    CHECK(glob("[abc]x", "bx"));
+    CHECK(!glob("[abc]x", "dx"));
+    CHECK(glob("[a-c]x", "cx"));
+    CHECK(glob("[!a-c]x", "dx"));
+    CHECK(glob("[^a-c]x", "dx"));
+    CHECK(!glob("[!a-c]x", "ax"));
+    CHECK(glob("[]]", "]"));
+    // an unclosed class is a plain '['
+    CHECK(glob("[ab", "[ab"));
+    CHECK(glob("\\*", "*"));
+    CHECK(!glob("\\*", "a"));
+}
+
+TEST(glob_double_star) {
+    CHECK(glob("**/build", "build"));
+    CHECK(glob("**/build", "a/b/build"));
+    CHECK(!glob("**/build", "a/rebuild"));
+    CHECK(glob("src/**/*.cpp", "src/main.cpp"));
+    CHECK(glob("src/**/*.cpp", "src/a/b/main.cpp"));
+    CHECK(!glob("src/**/*.cpp", "include/main.cpp"));
+    CHECK(glob("out/**", "out/a/b"));
+    CHECK(!glob("out/**", "output/a"));
+    CHECK(glob("a**z", "a/b/z"));
+}
+
+// a directory under the temporary directory with the given .gitignore
+static std::string ignore_directory(const char * name, const char * gitignore) {
+    const char * tmp = getenv("TMPDIR");
+    std::string path = std::string(tmp != nullptr ? tmp : "/tmp") + "/" + name;
+    mkdir(path.c_str(), 0755);
+    std::ofstream(path + "/.gitignore", std::ios::binary | std::ios::trunc) << gitignore;
+    return path;
+}
+
+static bool skips(const PathFilter & filter, const IgnoreLevel * level, const std::string & root, const std::string & relative, bool is_directory) {
+    std::string path = root + "/" + relative;
+    return filter.skip(level, path, path.find_last_of('/') + 1, root.size(), is_directory);
+}
+
+TEST(ignore_file_negation_and_directories) {
+    auto root = ignore_directory("FindReplaceTests_ignore", "# comment\n*.log\n!keep.log\nbuild/\n/top.txt\ndocs/*.tmp\n");
+    PathFilter filter;
+    auto level = filter.enter(nullptr, root);
+    CHECK(level != nullptr);
+
+    CHECK(skips(filter, level.get(), root, "a.log", false));
+    CHECK(skips(filter, level.get(), root, "sub/a.log", false));
+    // the later '!' rule takes keep.log back
+    CHECK(!skips(filter, level.get(), root, "keep.log", false));
+    CHECK(!skips(filter, level.get(), root, "sub/keep.log", false));
+    // a rule ending in '/' only matches directories
+    CHECK(skips(filter, level.get(), root, "build", true));
+    CHECK(!skips(filter, level.get(), root, "build", false));
+    // a rule with a '/' is matched against the path from the ignore file's directory
+    CHECK(skips(filter, level.get(), root, "top.txt", false));
+    CHECK(!skips(filter, level.get(), root, "sub/top.txt", false));
+    CHECK(skips(filter, level.get(), root, "docs/x.tmp", false));
+    CHECK(!skips(filter, level.get(), root, "sub/docs/x.tmp", false));
+    CHECK(!skips(filter, level.get(), root, "main.cpp", false));
+    CHECK(skips(filter, level.get(), root, ".git", true));
+
+    std::remove((root + "/.gitignore").c_str());
+    rmdir(root.c_str());
+}
+
+TEST(include_and_exclude) {
+    PathFilter filter;
+    filter.use_ignore_files(false);
+    filter.include("*.cpp");
+    filter.exclude("third_party/");
+    std::string root = "root";
+    CHECK(!skips(filter, nullptr, root, "src/main.cpp", false));
+    CHECK(skips(filter, nullptr, root, "src/main.h", false));
+    // includes only apply to files, directories are still walked
+    CHECK(!skips(filter, nullptr, root, "src", true));
+    CHECK(skips(filter, nullptr, root, "third_party", true));
+    CHECK(!skips(filter, nullptr, root, ".git", true));
+}
@@ -0,0 +1,65 @@
+#include "test.h"
+
+#include <replacement_template.h>
+
+#include <string>
+
+TEST(template_matches_std_format) {
+    std::string text = "before [ab-cd] after";
+    std::regex e("\\[(a)(b)-(c)(d)\\]");
+    std::cmatch m;
+    CHECK(std::regex_search(text.c_str(), m, e));
+    std::smatch sm;
+    CHECK(std::regex_search(text, sm, e));
+    for (const char * format : {"", "plain", "$$", "$&", "<$`|$'>", "$1$2$3$4", "$4-$3", "$01$04", "$0",
+                                "$12", "$9", "$", "a$", "$x", "$$1", "$$$&", "x$1y$2z"}) {
+        ReplacementTemplate replacement(format);
+        CHECK_EQUAL(replacement.format(m), m.format(format));
+        // not a pointer, the group text is copied before it is emitted
+        CHECK_EQUAL(replacement.format(sm), sm.format(format));
+    }
+}
+
+TEST(template_literal_text) {
+    CHECK(ReplacementTemplate("plain").is_literal());
+    CHECK_EQUAL(ReplacementTemplate("a$$b").literal_text(), std::string("a$b"));
+    CHECK(ReplacementTemplate("$x and $").is_literal());
+    CHECK(!ReplacementTemplate("$&").is_literal());
+    CHECK(!ReplacementTemplate("$1").is_literal());
+    CHECK(!ReplacementTemplate("$`").is_literal());
+
+    ReplacementTemplate replacement("a$1b$&");
+    auto & chunks = replacement.get_chunks();
+    CHECK_EQUAL(chunks.size(), std::size_t(4));
+    CHECK_EQUAL(chunks[0].group, ReplacementTemplate::LITERAL);
+    CHECK_EQUAL(chunks[1].group, 1);
+    CHECK_EQUAL(chunks[2].group, ReplacementTemplate::LITERAL);
+    CHECK_EQUAL(chunks[3].group, 0);
+}
+
+TEST(template_group_offset) {
+    // the second of two search items, (x)(y), wrapped in group 3 of the combined regex
+    std::string text = "xy";
+    std::regex e("((a)(b))|((x)(y))");
+    std::cmatch m;
+    CHECK(std::regex_search(text.c_str(), m, e));
+    CHECK_EQUAL(ReplacementTemplate("$2$1", 4).format(m), std::string("yx"));
+    // $0 and $& are the whole match whatever the offset
+    CHECK_EQUAL(ReplacementTemplate("$0$&", 4).format(m), std::string("xyxy"));
+}
+
+TEST(template_stable_pointers) {
+    std::string text = "key=value";
+    std::regex e("(\\w+)=(\\w+)");
+    std::cmatch m;
+    CHECK(std::regex_search(text.c_str(), m, e));
+    ReplacementTemplate replacement("$2:$1");
+    std::size_t calls = 0;
+    replacement.apply(m, [&](const char * data, std::size_t length, bool stable) {
+        calls++;
+        CHECK(stable);
+        // group text points into the searched text itself
+        if (length == 5) CHECK(data == text.c_str() + 4);
+    });
+    CHECK_EQUAL(calls, std::size_t(3));
+}
@@ -0,0 +1,108 @@
+#include "test.h"
+
+#include <scan_pipeline.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// the paths do not exist, the open stage skips a file it cannot open and the scan sees it anyway
+
+TEST(scan_pipeline_scans_and_emits_every_file) {
+    std::vector<std::string> emitted;
+    std::vector<std::thread::id> emitters;
+    {
+        ScanPipeline pipeline(2, 4,
+            [](const std::string & path, int fd, std::string & output) {
+                CHECK_EQUAL(fd, -1);
+                // a file without output is never emitted
+                if (path.back() % 2 == 0) output = path + "\n";
+            },
+            [&](const std::string & output) {
+                emitted.push_back(output);
+                emitters.push_back(std::this_thread::get_id());
+            });
+        for (int i = 0; i < 1000; i++) {
+            pipeline.submit("FindReplaceTests_missing/" + std::to_string(i));
+        }
+        pipeline.finish();
+    }
+    std::vector<std::string> expected;
+    for (int i = 0; i < 1000; i += 2) {
+        expected.push_back("FindReplaceTests_missing/" + std::to_string(i) + "\n");
+    }
+    std::sort(emitted.begin(), emitted.end());
+    std::sort(expected.begin(), expected.end());
+    CHECK(emitted == expected);
+    // one emitter writes everything
+    CHECK(std::count(emitters.begin(), emitters.end(), emitters.front()) == static_cast<long>(emitters.size()));
+}
+
+TEST(scan_pipeline_ordered_emits_in_submission_order) {
+    std::vector<std::string> emitted;
+    {
+        ScanPipeline pipeline(2, 4,
+            [](const std::string & path, int, std::string & output) {
+                // later files often finish first
+                int i = std::stoi(path.substr(path.find('/') + 1));
+                std::this_thread::sleep_for(std::chrono::microseconds((i * 7919) % 300));
+                if (i % 3 != 0) output = path;
+            },
+            [&](const std::string & output) {
+                emitted.push_back(output);
+            }, false, true);
+        for (int i = 0; i < 600; i++) {
+            pipeline.submit("FindReplaceTests_missing/" + std::to_string(i));
+            if (i % 100 == 0) pipeline.submit_output("output " + std::to_string(i));
+        }
+        pipeline.finish();
+    }
+    std::vector<std::string> expected;
+    for (int i = 0; i < 600; i++) {
+        if (i % 3 != 0) expected.push_back("FindReplaceTests_missing/" + std::to_string(i));
+        if (i % 100 == 0) expected.push_back("output " + std::to_string(i));
+    }
+    CHECK_EQUAL(emitted.size(), expected.size());
+    CHECK(emitted == expected);
+}
+
+TEST(scan_pipeline_hands_the_opened_file_to_the_scan) {
+    const char * tmp = getenv("TMPDIR");
+    std::vector<std::string> paths;
+    for (int i = 0; i < 20; i++) {
+        paths.push_back(std::string(tmp != nullptr ? tmp : "/tmp") + "/FindReplaceTests_pipeline_" + std::to_string(i));
+        std::ofstream(paths.back()) << "file " << i;
+    }
+    std::vector<int> fds(paths.size(), -1);
+    {
+        ScanPipeline pipeline(2, 4,
+            [&](const std::string & path, int fd, std::string &) {
+                // the scan reads the file it was given without opening it again
+                struct stat by_fd, by_path;
+                CHECK(fd != -1 && fstat(fd, &by_fd) == 0 && stat(path.c_str(), &by_path) == 0);
+                CHECK(by_fd.st_ino == by_path.st_ino);
+                int i = std::stoi(path.substr(path.rfind('_') + 1));
+                char text[32];
+                auto got = pread(fd, text, sizeof(text), 0);
+                CHECK(got > 0 && std::string(text, got) == "file " + std::to_string(i));
+                fds[i] = fd;
+            },
+            [](const std::string &) {});
+        for (auto & path : paths) pipeline.submit(path);
+        pipeline.finish();
+    }
+    for (std::size_t i = 0; i < paths.size(); i++) {
+        // closed once the scan returned
+        CHECK(fds[i] != -1 && fcntl(fds[i], F_GETFD) == -1);
+        std::remove(paths[i].c_str());
+    }
+}
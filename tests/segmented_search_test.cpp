@@ -0,0 +1,140 @@
+#include "test.h"
+
+#include <segmented_search.h>
+
+#include <string>
+
+// the matches of a single search from the start, as SegmentedSearch must find them
+static std::vector<SegmentMatch> sequential(const std::string & text, const std::regex & e) {
+    std::vector<SegmentMatch> matches;
+    for (std::cregex_iterator it(text.data(), text.data() + text.size(), e), end; it != end; ++it) {
+        matches.push_back({static_cast<std::size_t>(it->position(0)), static_cast<std::size_t>(it->length(0)), 0});
+    }
+    return matches;
+}
+
+// searches text in every number of segments up to max_segments and compares with a single search
+static void check_all_splits(const std::string & text, const char * pattern, std::size_t max_match_length, bool align_to_lines, std::size_t max_segments) {
+    std::regex e(pattern);
+    auto expected = sequential(text, e);
+    CHECK(!expected.empty());
+    for (std::size_t segments = 1; segments <= max_segments; segments++) {
+        SegmentedSearch search(text.data(), text.size(), e, max_match_length, align_to_lines, [](const std::cmatch &) { return std::size_t(0); });
+        if (segments % 2 == 0) {
+            search.run(segments);
+        } else {
+            search.run(segments, [](std::size_t count, const std::function<void(std::size_t)> & task) {
+                for (std::size_t i = count; i-- > 0; ) task(i);
+            });
+        }
+        auto & matches = search.get_matches();
+        CHECK_EQUAL(matches.size(), expected.size());
+        for (std::size_t i = 0; i < matches.size() && i < expected.size(); i++) {
+            CHECK_EQUAL(matches[i].position, expected[i].position);
+            CHECK_EQUAL(matches[i].length, expected[i].length);
+        }
+
+        // every match lies within the segment it is listed under
+        std::size_t count = search.segment_count();
+        CHECK_EQUAL(search.segment_begin(0), std::size_t(0));
+        CHECK_EQUAL(search.segment_end(count - 1), text.size());
+        CHECK_EQUAL(search.first_match_of(count), matches.size());
+        for (std::size_t s = 0; s < count; s++) {
+            for (std::size_t i = search.first_match_of(s); i < search.first_match_of(s + 1); i++) {
+                CHECK(matches[i].position >= search.segment_begin(s));
+                CHECK(matches[i].position + matches[i].length <= search.segment_end(s));
+            }
+        }
+    }
+}
+
+TEST(segmented_literal_straddles_boundaries) {
+    std::string text;
+    for (int i = 0; i < 40; i++) {
+        text += std::string(i % 7, '.') + "abc";
+    }
+    check_all_splits(text, "abc", 3, false, 30);
+}
+
+TEST(segmented_overlapping_candidates) {
+    // the next segment finds "aaa" at every offset, only every third one is a match
+    check_all_splits(std::string(100, 'a'), "aaa", 3, false, 40);
+}
+
+TEST(segmented_match_running_into_next_segment) {
+    // a segment starting on a 'b' finds "b" first, which is part of the match "ab" before it
+    std::string text;
+    for (int i = 0; i < 50; i++) text += "ab";
+    check_all_splits(text, "ab|b", 2, false, 40);
+}
+
+TEST(segmented_variable_length_matches) {
+    std::string text;
+    for (int i = 0; i < 60; i++) {
+        text += "x" + std::string(i % 5, 'y') + "z ";
+    }
+    check_all_splits(text, "xy*z|y+z", 6, false, 40);
+}
+
+TEST(segmented_aligned_to_lines) {
+    std::string text;
+    for (int i = 0; i < 30; i++) {
+        text += std::string(i % 4, ' ') + "key = " + std::to_string(i) + "\n";
+    }
+    // a line longer than a segment swallows several boundaries
+    text += std::string(200, 'k') + "key = long\n";
+    check_all_splits(text, "key = [^\\n]*", 0, true, 40);
+}
+
+// the matches a SegmentedSearch over the whole text finds, as "position+length" pairs
+static std::string positions(const std::string & text, const char * pattern, std::size_t segments) {
+    std::regex e(pattern);
+    SegmentedSearch search(text.data(), text.size(), e, 2, false, [](const std::cmatch &) { return std::size_t(0); });
+    search.run(segments);
+    std::string list;
+    for (auto & match : search.get_matches()) {
+        list += (list.empty() ? "" : " ") + std::to_string(match.position) + "+" + std::to_string(match.length);
+    }
+    return list;
+}
+
+TEST(segmented_empty_matches) {
+    // after an empty match, a non empty one at the same position is tried first, and the end
+    // of the text is a position of its own, as std::regex_iterator steps
+    CHECK_EQUAL(positions("aab", "a*?", 1), std::string("0+0 0+1 1+0 1+1 2+0 3+0"));
+    CHECK_EQUAL(positions("abab", "(?:)|ab", 1), std::string("0+0 0+2 2+0 2+2 4+0"));
+    CHECK_EQUAL(positions("xaaxbaay", "(a*)", 1), std::string("0+0 1+2 3+0 4+0 5+2 7+0 8+0"));
+    CHECK_EQUAL(positions("", "a*", 1), std::string("0+0"));
+
+    std::string aab, abab, xaaxbaay;
+    for (int i = 0; i < 20; i++) {
+        aab += "aab";
+        abab += "abab";
+        xaaxbaay += "xaaxbaay";
+    }
+    check_all_splits(aab, "a*?", 1, false, 40);
+    check_all_splits(abab, "(?:)|ab", 2, false, 40);
+    check_all_splits(xaaxbaay, "(a*)", 2, false, 40);
+    check_all_splits(xaaxbaay, "\\b|a+", 2, false, 40);
+    check_all_splits(xaaxbaay + "\n" + xaaxbaay, "^|y$", 1, true, 40);
+}
+
+TEST(segmented_classifies_each_pattern) {
+    // the combined regex of two search items, each wrapped in a group of its own
+    std::regex e("(foo)|(barbaz)");
+    std::string text;
+    for (int i = 0; i < 40; i++) {
+        text += i % 3 == 0 ? "barbaz" : "-foo";
+    }
+    auto classify = [](const std::cmatch & m) { return std::size_t(m[1].matched ? 0 : 1); };
+    for (std::size_t segments = 1; segments <= 30; segments++) {
+        SegmentedSearch search(text.data(), text.size(), e, 6, false, classify);
+        search.run(segments);
+        auto & matches = search.get_matches();
+        CHECK_EQUAL(matches.size(), std::size_t(40));
+        for (auto & match : matches) {
+            CHECK_EQUAL(match.pattern, std::size_t(text[match.position] == 'f' ? 0 : 1));
+            CHECK_EQUAL(match.length, std::size_t(match.pattern == 0 ? 3 : 6));
+        }
+    }
+}
@@ -0,0 +1,152 @@
+#include "test.h"
+
+#include <spool.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include <thread>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+static std::string temp_path(const char * name) {
+    const char * tmp = getenv("TMPDIR");
+    return std::string(tmp != nullptr ? tmp : "/tmp") + "/" + name;
+}
+
+// more than one chunk of bytes that differ from one offset to the next
+static std::string contents() {
+    std::string text(3*1024*1024 + 123, '\0');
+    for (std::size_t i = 0; i < text.size(); i++) {
+        text[i] = static_cast<char>('a' + (i * 7 + i / 4099) % 26);
+    }
+    return text;
+}
+
+// everything in the file from the start
+static std::string read_back(int fd) {
+    std::string text;
+    char buffer[65536];
+    ssize_t r;
+    lseek(fd, 0, SEEK_SET);
+    while ((r = read(fd, buffer, sizeof(buffer))) > 0) text.append(buffer, r);
+    return text;
+}
+
+// spools from a pipe that `text` is written into, as stdin would be
+static bool spool_pipe(const std::string & text, int out_fd, std::uint64_t & copied) {
+    int fds[2];
+    if (pipe(fds) != 0) return false;
+    std::thread feeder([&] {
+        std::size_t written = 0;
+        while (written < text.size()) {
+            auto w = write(fds[1], text.data() + written, std::min<std::size_t>(text.size() - written, 100000));
+            if (w <= 0) break;
+            written += w;
+        }
+        close(fds[1]);
+    });
+    bool ok = spool(fds[0], out_fd, copied);
+    feeder.join();
+    close(fds[0]);
+    return ok;
+}
+
+TEST(spool_pipe_into_memory_file) {
+    auto text = contents();
+    int out = memory_file("FindReplaceTests");
+    if (out == -1) {
+        out = open(temp_path("FindReplaceTests_spool_out").c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    }
+    std::uint64_t copied = 0;
+    CHECK(spool_pipe(text, out, copied));
+    CHECK_EQUAL(copied, std::uint64_t(text.size()));
+    CHECK(read_back(out) == text);
+    close(out);
+    std::remove(temp_path("FindReplaceTests_spool_out").c_str());
+}
+
+TEST(spool_file_into_file) {
+    auto text = contents();
+    auto in_path = temp_path("FindReplaceTests_spool_in");
+    auto out_path = temp_path("FindReplaceTests_spool_out");
+    std::ofstream(in_path, std::ios::binary) << text;
+    int in = open(in_path.c_str(), O_RDONLY);
+    int out = open(out_path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    // from the current position of the input on
+    lseek(in, 5, SEEK_SET);
+    std::uint64_t copied = 0;
+    CHECK(spool(in, out, copied));
+    CHECK_EQUAL(copied, std::uint64_t(text.size() - 5));
+    CHECK(read_back(out) == text.substr(5));
+    close(in);
+    close(out);
+    std::remove(in_path.c_str());
+    std::remove(out_path.c_str());
+}
+
+TEST(spool_file_into_appended_file) {
+    auto text = contents();
+    auto in_path = temp_path("FindReplaceTests_spool_in");
+    auto out_path = temp_path("FindReplaceTests_spool_out");
+    std::ofstream(in_path, std::ios::binary) << text;
+    std::ofstream(out_path, std::ios::binary) << "before\n";
+    int in = open(in_path.c_str(), O_RDONLY);
+    // as a stdout redirected with >>, copy_file_range() refuses it
+    int out = open(out_path.c_str(), O_RDWR | O_APPEND);
+    std::uint64_t copied = 0;
+    CHECK(spool(in, out, copied));
+    CHECK_EQUAL(copied, std::uint64_t(text.size()));
+    CHECK(read_back(out) == "before\n" + text);
+    close(in);
+    close(out);
+    std::remove(in_path.c_str());
+    std::remove(out_path.c_str());
+}
+
+TEST(spool_file_and_pipe_into_pipe) {
+    auto text = contents();
+    auto in_path = temp_path("FindReplaceTests_spool_in");
+    std::ofstream(in_path, std::ios::binary) << text;
+
+    for (bool from_pipe : {false, true}) {
+        int fds[2];
+        CHECK(pipe(fds) == 0);
+        std::string drained;
+        std::thread reader([&] {
+            char buffer[65536];
+            ssize_t r;
+            while ((r = read(fds[0], buffer, sizeof(buffer))) > 0) drained.append(buffer, r);
+        });
+        std::uint64_t copied = 0;
+        if (from_pipe) {
+            CHECK(spool_pipe(text, fds[1], copied));
+        } else {
+            // copy_file_range() cannot write into a pipe, the bytes go through user space
+            int in = open(in_path.c_str(), O_RDONLY);
+            CHECK(spool(in, fds[1], copied));
+            close(in);
+        }
+        close(fds[1]);
+        reader.join();
+        close(fds[0]);
+        CHECK_EQUAL(copied, std::uint64_t(text.size()));
+        CHECK(drained == text);
+    }
+    std::remove(in_path.c_str());
+}
+
+TEST(spool_reports_errors) {
+    auto in_path = temp_path("FindReplaceTests_spool_in");
+    std::ofstream(in_path, std::ios::binary) << "some text";
+    int in = open(in_path.c_str(), O_RDONLY);
+    // the output was never opened for writing
+    std::uint64_t copied = 0;
+    CHECK(!spool(in, in, copied));
+    CHECK_EQUAL(copied, std::uint64_t(0));
+    close(in);
+    std::remove(in_path.c_str());
+}
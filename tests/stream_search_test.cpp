@@ -0,0 +1,171 @@
+#include "test.h"
+
+#include <segmented_search.h>
+#include <stream_search.h>
+
+#include <algorithm>
+#include <cstring>
+#include <string>
+#include <utility>
+
+struct StreamResult {
+    bool found;
+    bool read_failed;
+    // every span in order, and the position and length of the matches among them
+    std::string text;
+    std::vector<std::pair<std::size_t, std::size_t>> matches;
+};
+
+// streams text in reads of at most `chunk` bytes
+static StreamResult stream(const std::string & text, const std::regex & e, std::size_t max_match_length, bool align_to_lines, std::size_t capacity, std::size_t chunk) {
+    StreamSearch search(e, max_match_length, align_to_lines, capacity, 1 << 20);
+    StreamResult result;
+    std::size_t position = 0;
+    result.found = search.run([&](char * buffer, std::size_t size) -> std::ptrdiff_t {
+        std::size_t n = std::min({size, chunk, text.size() - position});
+        memcpy(buffer, text.data() + position, n);
+        position += n;
+        return n;
+    }, [&](const char * begin, const char * end, const std::cmatch * m) {
+        if (m != nullptr) {
+            CHECK_EQUAL(std::string(begin, end), m->str(0));
+            result.matches.push_back({result.text.size(), static_cast<std::size_t>(end - begin)});
+        }
+        result.text.append(begin, end);
+    }, nullptr, result.read_failed);
+    CHECK_EQUAL(search.size(), text.size());
+    return result;
+}
+
+static void check_stream(const std::string & text, const char * pattern, std::size_t max_match_length, bool align_to_lines, std::size_t capacity) {
+    std::regex e(pattern);
+    std::vector<std::pair<std::size_t, std::size_t>> expected;
+    for (std::cregex_iterator it(text.data(), text.data() + text.size(), e), end; it != end; ++it) {
+        expected.push_back({it->position(0), it->length(0)});
+    }
+    CHECK(!expected.empty());
+    // a mapped file is searched in segments, the stream must agree with that too
+    SegmentedSearch segmented(text.data(), text.size(), e, max_match_length, align_to_lines, [](const std::cmatch &) { return std::size_t(0); });
+    segmented.run(7);
+    std::vector<std::pair<std::size_t, std::size_t>> mapped;
+    for (auto & match : segmented.get_matches()) mapped.push_back({match.position, match.length});
+    CHECK(mapped == expected);
+    bool non_empty = std::any_of(expected.begin(), expected.end(), [](const std::pair<std::size_t, std::size_t> & match) { return match.second != 0; });
+    for (std::size_t chunk : {1, 2, 3, 5, 7, 16, 64, 4096}) {
+        auto result = stream(text, e, max_match_length, align_to_lines, capacity, chunk);
+        CHECK_EQUAL(result.found, non_empty);
+        CHECK(!result.read_failed);
+        CHECK(result.text == text);
+        CHECK(result.matches == expected);
+    }
+}
+
+TEST(stream_match_across_reads_and_buffer_moves) {
+    std::string text;
+    for (int i = 0; i < 200; i++) {
+        text += std::string(i % 11, '.') + "needle";
+    }
+    // the smallest buffer, moved to its front over and over
+    check_stream(text, "needle", 6, false, 0);
+    check_stream(text, "needle", 6, false, 100);
+}
+
+TEST(stream_variable_length_matches) {
+    std::string text;
+    for (int i = 0; i < 100; i++) {
+        text += "<" + std::string(i % 6, 'x') + "> ";
+    }
+    check_stream(text, "<x*>", 7, false, 0);
+}
+
+TEST(stream_anchors_see_the_byte_before) {
+    std::string text;
+    for (int i = 0; i < 100; i++) {
+        text += i % 2 ? "word " : "sword ";
+    }
+    // '\b' must not match inside "sword" after the buffer moved
+    check_stream(text, "\\bword\\b", 4, false, 0);
+}
+
+TEST(stream_aligned_to_lines) {
+    std::string text;
+    for (int i = 0; i < 50; i++) {
+        text += "key " + std::string(i % 9, 'v') + "\n";
+    }
+    // a line longer than the buffer makes it grow
+    text += "key " + std::string(300, 'v') + "\n";
+    text += "key without newline";
+    // a greedy match reported before its line is complete would be cut short
+    check_stream(text, "key [^\\n]*", 0, true, 16);
+}
+
+TEST(stream_empty_matches) {
+    // after an empty match a non empty one at the same position comes first, and the end
+    // of the stream is a position of its own, as std::regex_iterator steps
+    std::string aab, abab, xaaxbaay, lines;
+    for (int i = 0; i < 30; i++) {
+        aab += "aab";
+        abab += "abab";
+        xaaxbaay += "xaaxbaay";
+        lines += std::string(i % 5, 'a') + "\n";
+    }
+    check_stream(aab, "a*?", 1, false, 0);
+    check_stream(abab, "(?:)|ab", 2, false, 0);
+    check_stream(xaaxbaay, "(a*)", 2, false, 0);
+    check_stream(xaaxbaay, "\\b|a+", 2, false, 0);
+    check_stream(lines, "a*", 0, true, 4);
+    check_stream(lines, "^|x*$", 0, true, 4);
+
+    auto result = stream("aab", std::regex("a*?"), 1, false, 0, 1);
+    std::vector<std::pair<std::size_t, std::size_t>> expected = {{0, 0}, {0, 1}, {1, 0}, {1, 1}, {2, 0}, {3, 0}};
+    CHECK(result.matches == expected);
+}
+
+TEST(stream_line_too_long) {
+    std::string text = "key 1\n" + std::string(1000, 'k') + "key 2\nkey 3\n" + std::string(1000, 'k');
+    std::regex e("key [0-9]");
+    for (std::size_t chunk : {1, 7, 4096}) {
+        StreamSearch search(e, 0, true, 16, 256);
+        bool read_failed;
+        std::string passed;
+        std::vector<std::string> matches;
+        search.run([&, position = std::size_t(0)](char * buffer, std::size_t size) mutable -> std::ptrdiff_t {
+            std::size_t n = std::min({size, chunk, text.size() - position});
+            memcpy(buffer, text.data() + position, n);
+            position += n;
+            return n;
+        }, [&](const char * begin, const char * end, const std::cmatch * m) {
+            if (m != nullptr) matches.push_back(std::string(begin, end));
+            passed.append(begin, end);
+        }, nullptr, read_failed);
+        // the long lines are passed on as they are, the lines after them are searched again
+        CHECK(passed == text);
+        CHECK(matches == std::vector<std::string>({"key 1", "key 3"}));
+        CHECK_EQUAL(search.skipped_lines(), std::uint64_t(2));
+    }
+}
+
+TEST(stream_flush_stops_and_read_errors) {
+    std::regex e("a");
+    StreamSearch search(e, 1, false, 16, 16);
+    int reads = 0;
+    bool read_failed;
+    bool found = search.run([&](char * buffer, std::size_t) -> std::ptrdiff_t {
+        if (++reads == 3) return -1;
+        buffer[0] = 'a';
+        return 1;
+    }, [](const char *, const char *, const std::cmatch *) {}, [] { return true; }, read_failed);
+    CHECK(found);
+    CHECK(read_failed);
+    CHECK_EQUAL(search.size(), std::uint64_t(2));
+
+    StreamSearch stopped(e, 1, false, 16, 16);
+    reads = 0;
+    stopped.run([&](char * buffer, std::size_t) -> std::ptrdiff_t {
+        reads++;
+        buffer[0] = 'b';
+        return 1;
+    }, [](const char *, const char *, const std::cmatch *) {}, [&] { return reads < 5; }, read_failed);
+    CHECK_EQUAL(reads, 5);
+    CHECK(!read_failed);
+}
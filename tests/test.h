@@ -0,0 +1,47 @@
+#pragma once
+
+#include <iostream>
+#include <vector>
+
+// every TEST in the files linked into FindReplaceTests is run by tests/main.cpp
+
+struct TestCase {
+    const char * name;
+    void (*run)();
+};
+
+std::vector<TestCase> & test_cases();
+
+// the number of failed checks so far
+extern int test_failures;
+
+struct TestRegistration {
+    TestRegistration(const char * name, void (*run)()) {
+        test_cases().push_back({name, run});
+    }
+};
+
+#define TEST(name) \
+    static void name(); \
+    static TestRegistration name##_registration(#name, name); \
+    static void name()
+
+// reports a failed check and carries on with the test
+#define CHECK(condition) \
+    do { \
+        if (!(condition)) { \
+            std::cout << __FILE__ << ":" << __LINE__ << ": check failed: " #condition << std::endl; \
+            test_failures++; \
+        } \
+    } while (0)
+
+#define CHECK_EQUAL(a, b) \
+    do { \
+        auto check_a = (a); \
+        auto check_b = (b); \
+        if (!(check_a == check_b)) { \
+            std::cout << __FILE__ << ":" << __LINE__ << ": check failed: " #a " == " #b \
+                << " (" << check_a << " != " << check_b << ")" << std::endl; \
+            test_failures++; \
+        } \
+    } while (0)
@@ -0,0 +1,78 @@
+#include "test.h"
+
+#include <thread_pool.h>
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <set>
+#include <thread>
+
+TEST(thread_pool_runs_every_task) {
+    ThreadPool pool(4);
+    CHECK_EQUAL(pool.size(), std::size_t(4));
+    CHECK(!ThreadPool::on_worker());
+    std::atomic<int> count {0};
+    std::atomic<int> off_worker {0};
+    for (int i = 0; i < 10000; i++) {
+        pool.submit([&] {
+            if (!ThreadPool::on_worker()) off_worker++;
+            count++;
+        });
+    }
+    pool.wait();
+    CHECK_EQUAL(count.load(), 10000);
+    CHECK_EQUAL(off_worker.load(), 0);
+
+    // the pool can be waited on again after more work
+    pool.submit([&] { count++; });
+    pool.wait();
+    CHECK_EQUAL(count.load(), 10001);
+}
+
+// each task submits two more down to `depth`, all onto the deque of the worker running it
+static void tree(ThreadPool & pool, std::atomic<int> & count, int depth) {
+    count++;
+    if (depth == 0) return;
+    for (int i = 0; i < 2; i++) {
+        pool.submit([&pool, &count, depth] { tree(pool, count, depth - 1); });
+    }
+}
+
+TEST(thread_pool_waits_for_nested_tasks) {
+    ThreadPool pool(3);
+    std::atomic<int> count {0};
+    pool.submit([&] { tree(pool, count, 11); });
+    pool.wait();
+    CHECK_EQUAL(count.load(), (1 << 12) - 1);
+}
+
+TEST(thread_pool_idle_workers_steal) {
+    ThreadPool pool(4);
+    std::atomic<int> count {0};
+    std::atomic<bool> stolen {false};
+    std::mutex mutex;
+    std::set<std::thread::id> threads;
+    pool.submit([&] {
+        auto parent = std::this_thread::get_id();
+        for (int i = 0; i < 64; i++) {
+            pool.submit([&, parent] {
+                std::this_thread::sleep_for(std::chrono::microseconds(200));
+                if (std::this_thread::get_id() != parent) stolen = true;
+                std::lock_guard<std::mutex> lock(mutex);
+                threads.insert(std::this_thread::get_id());
+                count++;
+            });
+        }
+        // the tasks are all on this worker's deque, while it is busy here
+        // only another worker taking them from it gets any of them done
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+        while (!stolen && std::chrono::steady_clock::now() < deadline) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    });
+    pool.wait();
+    CHECK(stolen);
+    CHECK_EQUAL(count.load(), 64);
+    CHECK(threads.size() > 1);
+}